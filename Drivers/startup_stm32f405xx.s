@@ -44,6 +44,17 @@ defined in linker script */
 .word  _sbss
 /* end address for the .bss section. defined in linker script */
 .word  _ebss
+/* start address for the initialization values of the .ccmram section. defined in linker script */
+.word  _siccmram
+/* start and end address for the .ccmram section. defined in linker script */
+.word  _sccmram
+.word  _eccmram
+/* start and end address for the .ccmram_bss section. defined in linker script */
+.word  _sccmram_bss
+.word  _eccmram_bss
+/* start and end address for the .sram2_bss section. defined in linker script */
+.word  _ssram2_bss
+.word  _esram2_bss
 /* stack used for SystemInit_ExtMemCtl; always internal RAM used */
 
 /**
@@ -92,6 +103,51 @@ LoopFillZerobss:
   cmp r2, r4
   bcc FillZerobss
 
+/* Copy the ccmram segment initializers from flash to CCM RAM */
+  ldr r0, =_sccmram
+  ldr r1, =_eccmram
+  ldr r2, =_siccmram
+  movs r3, #0
+  b LoopCopyCcmramInit
+
+CopyCcmramInit:
+  ldr r4, [r2, r3]
+  str r4, [r0, r3]
+  adds r3, r3, #4
+
+LoopCopyCcmramInit:
+  adds r4, r0, r3
+  cmp r4, r1
+  bcc CopyCcmramInit
+
+/* Zero fill the ccmram_bss segment. */
+  ldr r2, =_sccmram_bss
+  ldr r4, =_eccmram_bss
+  movs r3, #0
+  b LoopFillZeroCcmram
+
+FillZeroCcmram:
+  str  r3, [r2]
+  adds r2, r2, #4
+
+LoopFillZeroCcmram:
+  cmp r2, r4
+  bcc FillZeroCcmram
+
+/* Zero fill the sram2_bss segment. */
+  ldr r2, =_ssram2_bss
+  ldr r4, =_esram2_bss
+  movs r3, #0
+  b LoopFillZeroSram2
+
+FillZeroSram2:
+  str  r3, [r2]
+  adds r2, r2, #4
+
+LoopFillZeroSram2:
+  cmp r2, r4
+  bcc FillZeroSram2
+
 /* Call the clock system intitialization function.*/
   bl  SystemInit   
 /* Call static constructors */
@@ -1,22 +1,75 @@
 #include "stm32f4xx.h"
+#include <stddef.h>
 #include "global_constants.h"
 #include "global_variables.h"
 #include "bdshot.h"
 
 static void fill_bb_BDshot_buffer(uint16_t m1_value, uint16_t m2_value, uint16_t m3_value, uint16_t m4_value);
-static void update_motors_rpm();
-static uint32_t get_BDshot_response(uint32_t raw_buffer[], const uint8_t motor_shift);
-static void read_BDshot_response(uint32_t value, uint8_t motor);
-static bool BDshot_check_checksum(uint16_t value);
+RAMFUNC static void update_motors_rpm();
+RAMFUNC static uint32_t get_BDshot_response(uint32_t raw_buffer[], const uint8_t motor_shift);
+RAMFUNC static void read_BDshot_response(uint32_t value, uint8_t motor);
+RAMFUNC static bool BDshot_check_checksum(uint16_t value);
 static uint16_t prepare_BDshot_package(uint16_t value);
 static uint16_t calculate_BDshot_checksum(uint16_t value);
+static bool BDshot_watchdog();
+RAMFUNC static void BDshot_stream_done();
+RAMFUNC static void BDshot_stream_error(bool reception, bool fatal);
+RAMFUNC static void BDshot_frame_finished(BDshot_frame_status status);
+static void BDshot_reset_pipeline();
+static void BDshot_DMA_mode_registers(BDshot_DMA_mode mode, uint32_t *mburst, uint32_t *fcr);
+
+#if defined(USE_BDSHOT_PROBES)
+RAMFUNC static void BDshot_probe_record(BDshot_probe_stage stage, uint32_t cycles);
+#define BDSHOT_PROBE_TIMESTAMP(timestamp) ((timestamp) = DWT->CYCCNT)
+#define BDSHOT_PROBE_RECORD(stage, from, to) BDshot_probe_record((stage), (to) - (from))
+#else
+#define BDSHOT_PROBE_TIMESTAMP(timestamp)
+#define BDSHOT_PROBE_RECORD(stage, from, to)
+#endif
+
+volatile BDshot_statistics_t bdshot_statistics;
+volatile BDshot_scheduler_statistics_t bdshot_scheduler_statistics;
 
 // flags for reception or transmission:
 static bool bdshot_reception_1 = true;
 static bool bdshot_reception_2 = true;
 
-void DMA2_Stream6_IRQHandler(void)
+// frame state machine (IDLE -> TX -> RX -> DECODE -> IDLE):
+static volatile BDshot_state bdshot_state = BDSHOT_IDLE;
+static volatile uint32_t bdshot_frame_id;           // id of the last submitted frame
+static volatile uint32_t bdshot_completed_frame_id; // id of the last finished (decoded or aborted) frame
+static BDshot_callback bdshot_frame_callback;       // callback of the frame in progress
+
+// watchdog state (DWT->CYCCNT at frame start, how many streams finished reception, stream was stopped by an error, frame in progress got an error):
+static uint32_t bdshot_frame_start;
+static volatile uint8_t bdshot_streams_done;
+static volatile bool bdshot_error;
+static volatile bool bdshot_frame_error;
+
+// DMA burst and FIFO settings for transmission and reception (set by BDshot_set_DMA_mode()):
+static uint32_t bdshot_tx_mburst;
+static uint32_t bdshot_tx_fcr;
+static uint32_t bdshot_rx_mburst;
+static uint32_t bdshot_rx_fcr;
+static bool bdshot_dma_mode_set = false;
+
+// values for scheduler - written to the inactive buffer and swapped (initialized as 0 command for ESCs):
+static uint16_t bdshot_published_values[2][MOTORS_COUNT] = {{1953, 1953, 1953, 1953}, {1953, 1953, 1953, 1953}};
+static volatile uint8_t bdshot_published_index;
+
+#if defined(USE_BDSHOT_PROBES)
+volatile BDshot_probe_t bdshot_probes[BDSHOT_PROBE_STAGES];
+
+// timestamps of the current frame (DWT->CYCCNT) - index 0 for DMA2_Stream6, 1 for DMA2_Stream2:
+static uint32_t bdshot_probe_tx_start;
+static uint32_t bdshot_probe_isr_entry[2];
+static uint32_t bdshot_probe_rx_enable[2];
+static uint32_t bdshot_probe_rx_complete;
+#endif
+
+RAMFUNC void DMA2_Stream6_IRQHandler(void)
 {
+    BDSHOT_PROBE_TIMESTAMP(bdshot_probe_isr_entry[0]);
 
     if (DMA2->HISR & DMA_HISR_TCIF6)
     {
@@ -24,6 +77,8 @@ void DMA2_Stream6_IRQHandler(void)
 
         if (bdshot_reception_1)
         {
+            BDSHOT_PROBE_RECORD(BDSHOT_PROBE_TX_1_4, bdshot_probe_tx_start, bdshot_probe_isr_entry[0]);
+
             // set GPIOs as inputs:
             GPIOA->MODER &= ~GPIO_MODER_MODER2;
             GPIOA->MODER &= ~GPIO_MODER_MODER3;
@@ -34,17 +89,29 @@ void DMA2_Stream6_IRQHandler(void)
             TIM1->ARR = DSHOT_BB_FRAME_LENGTH * DSHOT_MODE / BDSHOT_RESPONSE_BITRATE / BDSHOT_RESPONSE_OVERSAMPLING - 1;
             TIM1->CCR1 = DSHOT_BB_FRAME_LENGTH * DSHOT_MODE / BDSHOT_RESPONSE_BITRATE / BDSHOT_RESPONSE_OVERSAMPLING;
 
-            DMA2_Stream6->CR &= ~(DMA_SxCR_DIR);
+            DMA2_Stream6->CR &= ~(DMA_SxCR_DIR | DMA_SxCR_MBURST);
+            DMA2_Stream6->CR |= bdshot_rx_mburst;
+            DMA2_Stream6->FCR = bdshot_rx_fcr;
             DMA2_Stream6->PAR = (uint32_t)(&(GPIOA->IDR));
             DMA2_Stream6->M0AR = (uint32_t)(dshot_bb_buffer_1_4_r);
             // Main idea:
             // After sending DShot frame to ESC start receiving GPIO values.
             // Capture data (probing longer than ESC response).
             // There is ~33 [us] gap before the response so it is necessary to add more samples:
-            DMA2_Stream6->NDTR = ((int)(33 * BDSHOT_RESPONSE_BITRATE / 1000 + BDSHOT_RESPONSE_LENGTH + 1) * BDSHOT_RESPONSE_OVERSAMPLING);
+            DMA2_Stream6->NDTR = BDSHOT_RESPONSE_BUFFER_LENGTH;
 
             DMA2_Stream6->CR |= DMA_SxCR_EN;
+            BDSHOT_PROBE_TIMESTAMP(bdshot_probe_rx_enable[0]);
+            BDSHOT_PROBE_RECORD(BDSHOT_PROBE_TURNAROUND_1_4, bdshot_probe_isr_entry[0], bdshot_probe_rx_enable[0]);
             bdshot_reception_1 = false;
+            bdshot_state = BDSHOT_RX;
+        }
+        else
+        {
+            // response was captured:
+            BDSHOT_PROBE_RECORD(BDSHOT_PROBE_RX_1_4, bdshot_probe_rx_enable[0], bdshot_probe_isr_entry[0]);
+            BDSHOT_PROBE_TIMESTAMP(bdshot_probe_rx_complete);
+            BDshot_stream_done();
         }
     }
 
@@ -55,21 +122,33 @@ void DMA2_Stream6_IRQHandler(void)
     if (DMA2->HISR & DMA_HISR_DMEIF6)
     {
         DMA2->HIFCR |= DMA_HIFCR_CDMEIF6;
+        BDshot_stream_error(!bdshot_reception_1, false);
+    }
+    if (DMA2->HISR & DMA_HISR_FEIF6)
+    {
+        DMA2->HIFCR |= DMA_HIFCR_CFEIF6;
+        bdshot_statistics.fifo_errors++;
     }
     if (DMA2->HISR & DMA_HISR_TEIF6)
     {
+        // stream is disabled by hardware - it will be re-initialized before next frame:
         DMA2->HIFCR |= DMA_HIFCR_CTEIF6;
+        BDshot_stream_error(!bdshot_reception_1, true);
     }
 }
 
-void DMA2_Stream2_IRQHandler(void)
+RAMFUNC void DMA2_Stream2_IRQHandler(void)
 {
+    BDSHOT_PROBE_TIMESTAMP(bdshot_probe_isr_entry[1]);
+
     if (DMA2->LISR & DMA_LISR_TCIF2)
     {
         DMA2->LIFCR |= DMA_LIFCR_CTCIF2;
 
         if (bdshot_reception_2)
         {
+            BDSHOT_PROBE_RECORD(BDSHOT_PROBE_TX_2_3, bdshot_probe_tx_start, bdshot_probe_isr_entry[1]);
+
             // set GPIOs as inputs:
             GPIOB->MODER &= ~GPIO_MODER_MODER0;
             GPIOB->MODER &= ~GPIO_MODER_MODER1;
@@ -80,17 +159,29 @@ void DMA2_Stream2_IRQHandler(void)
             TIM8->ARR = DSHOT_BB_FRAME_LENGTH * DSHOT_MODE / BDSHOT_RESPONSE_BITRATE / BDSHOT_RESPONSE_OVERSAMPLING - 1;
             TIM8->CCR1 = DSHOT_BB_FRAME_LENGTH * DSHOT_MODE / BDSHOT_RESPONSE_BITRATE / BDSHOT_RESPONSE_OVERSAMPLING;
 
-            DMA2_Stream2->CR &= ~(DMA_SxCR_DIR);
+            DMA2_Stream2->CR &= ~(DMA_SxCR_DIR | DMA_SxCR_MBURST);
+            DMA2_Stream2->CR |= bdshot_rx_mburst;
+            DMA2_Stream2->FCR = bdshot_rx_fcr;
             DMA2_Stream2->PAR = (uint32_t)(&(GPIOB->IDR));
             DMA2_Stream2->M0AR = (uint32_t)(dshot_bb_buffer_2_3_r);
             // Main idea:
             // After sending DShot frame to ESC start receiving GPIO values.
             // Capture data (probing longer than ESC response).
             // There is ~33 [us] gap before the response so it is necessary to add more samples:
-            DMA2_Stream2->NDTR = ((int)(33 * BDSHOT_RESPONSE_BITRATE / 1000 + BDSHOT_RESPONSE_LENGTH + 1) * BDSHOT_RESPONSE_OVERSAMPLING);
+            DMA2_Stream2->NDTR = BDSHOT_RESPONSE_BUFFER_LENGTH;
 
             DMA2_Stream2->CR |= DMA_SxCR_EN;
+            BDSHOT_PROBE_TIMESTAMP(bdshot_probe_rx_enable[1]);
+            BDSHOT_PROBE_RECORD(BDSHOT_PROBE_TURNAROUND_2_3, bdshot_probe_isr_entry[1], bdshot_probe_rx_enable[1]);
             bdshot_reception_2 = false;
+            bdshot_state = BDSHOT_RX;
+        }
+        else
+        {
+            // response was captured:
+            BDSHOT_PROBE_RECORD(BDSHOT_PROBE_RX_2_3, bdshot_probe_rx_enable[1], bdshot_probe_isr_entry[1]);
+            BDSHOT_PROBE_TIMESTAMP(bdshot_probe_rx_complete);
+            BDshot_stream_done();
         }
     }
 
@@ -101,25 +192,116 @@ void DMA2_Stream2_IRQHandler(void)
     if (DMA2->LISR & DMA_LISR_DMEIF2)
     {
         DMA2->LIFCR |= DMA_LIFCR_CDMEIF2;
+        BDshot_stream_error(!bdshot_reception_2, false);
+    }
+    if (DMA2->LISR & DMA_LISR_FEIF2)
+    {
+        DMA2->LIFCR |= DMA_LIFCR_CFEIF2;
+        bdshot_statistics.fifo_errors++;
     }
     if (DMA2->LISR & DMA_LISR_TEIF2)
     {
+        // stream is disabled by hardware - it will be re-initialized before next frame:
         DMA2->LIFCR |= DMA_LIFCR_CTEIF2;
+        BDshot_stream_error(!bdshot_reception_2, true);
+    }
+}
+
+RAMFUNC void TIM7_IRQHandler()
+{
+    // BDshot scheduler - frames are sent with fixed rate whatever the main loop is doing:
+    if (TIM_SR_UIF & TIM7->SR)
+    {
+        TIM7->SR &= ~TIM_SR_UIF;
+
+        static uint32_t last_tick;
+        const uint32_t now = DWT->CYCCNT;
+        const uint32_t nominal_period = SYSTEM_CLOCK_MHZ * 1000000 / BDSHOT_OUTPUT_RATE_HZ;
+
+        // reader has higher priority than publisher so published buffer is always complete:
+        if (BDshot_submit(bdshot_published_values[bdshot_published_index], NULL) == 0)
+        {
+            bdshot_scheduler_statistics.frames_missed++;
+        }
+
+        if (bdshot_scheduler_statistics.ticks > 0)
+        {
+            const uint32_t period = now - last_tick;
+            const uint32_t jitter = period > nominal_period ? period - nominal_period : nominal_period - period;
+
+            if (period < bdshot_scheduler_statistics.period_min_cycles || bdshot_scheduler_statistics.ticks == 1)
+            {
+                bdshot_scheduler_statistics.period_min_cycles = period;
+            }
+            if (period > bdshot_scheduler_statistics.period_max_cycles)
+            {
+                bdshot_scheduler_statistics.period_max_cycles = period;
+            }
+            if (jitter > bdshot_scheduler_statistics.jitter_max_cycles)
+            {
+                bdshot_scheduler_statistics.jitter_max_cycles = jitter;
+            }
+            bdshot_scheduler_statistics.jitter_mean_cycles += ((float)jitter - bdshot_scheduler_statistics.jitter_mean_cycles) / bdshot_scheduler_statistics.ticks;
+        }
+        last_tick = now;
+        bdshot_scheduler_statistics.ticks++;
     }
 }
 
 void update_motors()
 {
-    // prepare for sending:
-    update_motors_rpm();
+    // send values from motor pointers (responses from the previous frame are decoded in the DMA ISR):
+    const uint16_t motor_values[MOTORS_COUNT] = {*motor_1_value_pointer, *motor_2_value_pointer, *motor_3_value_pointer, *motor_4_value_pointer};
+
+#if defined(USE_BDSHOT_SCHEDULER)
+    // frames are sent by TIM7:
+    BDshot_publish(motor_values);
+#else
+    BDshot_submit(motor_values, NULL);
+#endif
+}
+
+void BDshot_publish(const uint16_t motor_values[])
+{
+    // write to the buffer not used by scheduler and swap them:
+    const uint8_t index = bdshot_published_index ^ 1;
+    for (uint8_t motor = 0; motor < MOTORS_COUNT; motor++)
+    {
+        bdshot_published_values[index][motor] = motor_values[motor];
+    }
+    bdshot_published_index = index;
+}
 
-    fill_bb_BDshot_buffer(prepare_BDshot_package(*motor_1_value_pointer),
-                          prepare_BDshot_package(*motor_2_value_pointer),
-                          prepare_BDshot_package(*motor_3_value_pointer),
-                          prepare_BDshot_package(*motor_4_value_pointer));
+uint32_t BDshot_submit(const uint16_t motor_values[], BDshot_callback callback)
+{
+    if (!bdshot_dma_mode_set)
+    {
+        BDshot_set_DMA_mode(BDSHOT_DMA_TX_MODE, BDSHOT_DMA_RX_MODE);
+    }
+
+    // check if previous frame was finished or recover stalled pipeline:
+    if (!BDshot_watchdog())
+    {
+        return 0;
+    }
+
+    // buffers are not used by DMA in IDLE state:
+    fill_bb_BDshot_buffer(prepare_BDshot_package(motor_values[0]),
+                          prepare_BDshot_package(motor_values[1]),
+                          prepare_BDshot_package(motor_values[2]),
+                          prepare_BDshot_package(motor_values[3]));
+
+    // frame id 0 means "no frame":
+    bdshot_frame_id = bdshot_frame_id + 1 == 0 ? 1 : bdshot_frame_id + 1;
+    bdshot_frame_callback = callback;
+    bdshot_state = BDSHOT_TX;
 
     bdshot_reception_1 = true;
     bdshot_reception_2 = true;
+    bdshot_streams_done = 0;
+    bdshot_frame_error = false;
+    bdshot_statistics.frames_sent++;
+    bdshot_frame_start = DWT->CYCCNT;
 
     // set GPIOs as output:
     GPIOB->MODER |= GPIO_MODER_MODER0_0;
@@ -127,12 +309,16 @@ void update_motors()
     GPIOA->MODER |= GPIO_MODER_MODER2_0;
     GPIOA->MODER |= GPIO_MODER_MODER3_0;
 
-    DMA2_Stream6->CR |= DMA_SxCR_DIR_0;
+    DMA2_Stream6->CR &= ~DMA_SxCR_MBURST;
+    DMA2_Stream6->CR |= DMA_SxCR_DIR_0 | bdshot_tx_mburst;
+    DMA2_Stream6->FCR = bdshot_tx_fcr;
     DMA2_Stream6->PAR = (uint32_t)(&(GPIOA->BSRR));
     DMA2_Stream6->M0AR = (uint32_t)(dshot_bb_buffer_1_4);
     DMA2_Stream6->NDTR = DSHOT_BB_BUFFER_LENGTH * DSHOT_BB_FRAME_SECTIONS;
 
-    DMA2_Stream2->CR |= DMA_SxCR_DIR_0;
+    DMA2_Stream2->CR &= ~DMA_SxCR_MBURST;
+    DMA2_Stream2->CR |= DMA_SxCR_DIR_0 | bdshot_tx_mburst;
+    DMA2_Stream2->FCR = bdshot_tx_fcr;
     DMA2_Stream2->PAR = (uint32_t)(&(GPIOB->BSRR));
     DMA2_Stream2->M0AR = (uint32_t)(dshot_bb_buffer_2_3);
     DMA2_Stream2->NDTR = DSHOT_BB_BUFFER_LENGTH * DSHOT_BB_FRAME_SECTIONS;
@@ -194,6 +380,20 @@ void update_motors()
     DMA2_Stream6->CR |= DMA_SxCR_EN;
     DMA2_Stream2->CR |= DMA_SxCR_EN;
 #endif
+    BDSHOT_PROBE_TIMESTAMP(bdshot_probe_tx_start);
+
+    return bdshot_frame_id;
+}
+
+BDshot_state BDshot_get_state()
+{
+    return bdshot_state;
+}
+
+bool BDshot_frame_done(uint32_t frame_id)
+{
+    // frame ids are increasing (wrap around is handled by signed difference):
+    return (int32_t)(bdshot_completed_frame_id - frame_id) >= 0;
 }
 
 #if defined(BIT_BANGING_V1)
@@ -348,7 +548,242 @@ static void fill_bb_BDshot_buffer(uint16_t m1_value, uint16_t m2_value, uint16_t
 }
 #endif
 
-static void update_motors_rpm()
+static bool BDshot_watchdog()
+{
+    // returns true if a new frame can be sent.
+    // DMA ISRs can finish the frame at any moment - state is checked and streams are stopped with interrupts masked, so the frame is finished only once:
+    bool ready = true;
+    bool aborted = false;
+    BDshot_frame_status status = BDSHOT_FRAME_ERROR;
+
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    if (bdshot_state == BDSHOT_IDLE)
+    {
+        // previous frame is completed (and its status delivered) - late errors are only counted:
+        bdshot_error = false;
+    }
+    else if (bdshot_state == BDSHOT_DECODE)
+    {
+        // responses are being decoded by interrupted DMA ISR - it finishes the frame:
+        bdshot_statistics.frames_skipped++;
+        ready = false;
+    }
+    else if (bdshot_error)
+    {
+        // stream of the frame in progress was disabled by hardware - it will never complete:
+        BDshot_reset_pipeline();
+        aborted = true;
+    }
+    else if (DWT->CYCCNT - bdshot_frame_start < BDSHOT_FRAME_BUDGET_US * SYSTEM_CLOCK_MHZ)
+    {
+        // frame is still in progress - don't interrupt it:
+        bdshot_statistics.frames_skipped++;
+        ready = false;
+    }
+    else
+    {
+        // frame wasn't completed in its time budget - stream or timer stopped:
+        bdshot_statistics.stalls++;
+        BDshot_reset_pipeline();
+        aborted = true;
+        status = BDSHOT_FRAME_TIMEOUT;
+    }
+
+    __set_PRIMASK(primask);
+
+    if (aborted)
+    {
+        // streams are stopped - ISRs can't finish this frame anymore:
+        BDshot_frame_finished(status);
+    }
+    return ready;
+}
+
+RAMFUNC static void BDshot_stream_done()
+{
+    // both DMA ISRs can call it (with different priorities) so counting has to be atomic:
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    const uint8_t streams_done = ++bdshot_streams_done;
+    __set_PRIMASK(primask);
+
+    if (streams_done == 2)
+    {
+        const uint32_t frame_cycles = DWT->CYCCNT - bdshot_frame_start;
+
+        bdshot_statistics.frames_completed++;
+        bdshot_statistics.last_frame_cycles = frame_cycles;
+        if (frame_cycles > bdshot_statistics.max_frame_cycles)
+        {
+            bdshot_statistics.max_frame_cycles = frame_cycles;
+        }
+        if (frame_cycles > BDSHOT_FRAME_BUDGET_US * SYSTEM_CLOCK_MHZ)
+        {
+            bdshot_statistics.budget_overruns++;
+        }
+
+        // BDshot bit banging reads whole GPIO register - now responses can be decoded:
+        bdshot_state = BDSHOT_DECODE;
+        update_motors_rpm();
+        BDSHOT_PROBE_RECORD(BDSHOT_PROBE_DECODE, bdshot_probe_rx_complete, DWT->CYCCNT);
+        BDshot_frame_finished(bdshot_frame_error ? BDSHOT_FRAME_ERROR : BDSHOT_FRAME_OK);
+    }
+}
+
+RAMFUNC static void BDshot_frame_finished(BDshot_frame_status status)
+{
+    // set IDLE before callback so that the next frame can be submitted from it:
+    const BDshot_callback callback = bdshot_frame_callback;
+    bdshot_frame_callback = NULL;
+    bdshot_completed_frame_id = bdshot_frame_id;
+    bdshot_state = BDSHOT_IDLE;
+
+    if (callback != NULL)
+    {
+        callback(bdshot_completed_frame_id, status);
+    }
+}
+
+RAMFUNC static void BDshot_stream_error(bool reception, bool fatal)
+{
+    if (reception)
+    {
+        bdshot_statistics.rx_errors++;
+    }
+    else
+    {
+        bdshot_statistics.tx_errors++;
+    }
+
+    if (bdshot_state == BDSHOT_IDLE)
+    {
+        // no frame in progress - there is nothing to report:
+        return;
+    }
+    if (fatal)
+    {
+        // stream is stopped - frame is aborted by the watchdog:
+        bdshot_error = true;
+    }
+    else
+    {
+        // transfer continues - frame completes but it is reported as an error:
+        bdshot_frame_error = true;
+    }
+}
+
+static void BDshot_reset_pipeline()
+{
+    // stream ISRs must not run while streams are stopped (clearing EN sets TCIF - the ISR would
+    // switch the stream to reception again or report half captured response as a decoded frame):
+    NVIC_DisableIRQ(DMA2_Stream6_IRQn);
+    NVIC_DisableIRQ(DMA2_Stream2_IRQn);
+
+    // stop time basement for both streams:
+    TIM1->CR1 &= ~TIM_CR1_CEN;
+    TIM8->CR1 &= ~TIM_CR1_CEN;
+
+    // disable streams (current transfer has to be finished before EN bit goes low):
+    DMA2_Stream6->CR &= ~DMA_SxCR_EN;
+    DMA2_Stream2->CR &= ~DMA_SxCR_EN;
+    while ((DMA2_Stream6->CR & DMA_SxCR_EN) || (DMA2_Stream2->CR & DMA_SxCR_EN))
+    {
+        ; // wait
+    }
+
+    // clear all flags and set default configuration:
+    DMA2->HIFCR = DMA_HIFCR_CTCIF6 | DMA_HIFCR_CHTIF6 | DMA_HIFCR_CTEIF6 | DMA_HIFCR_CDMEIF6 | DMA_HIFCR_CFEIF6;
+    DMA2->LIFCR = DMA_LIFCR_CTCIF2 | DMA_LIFCR_CHTIF2 | DMA_LIFCR_CTEIF2 | DMA_LIFCR_CDMEIF2 | DMA_LIFCR_CFEIF2;
+    DMA2_Stream6->CR = BDSHOT_DMA_STREAM_CONFIG;
+    DMA2_Stream2->CR = BDSHOT_DMA_STREAM_CONFIG;
+    NVIC_ClearPendingIRQ(DMA2_Stream6_IRQn);
+    NVIC_ClearPendingIRQ(DMA2_Stream2_IRQn);
+
+    // timers will be configured and started again with the next frame:
+    TIM1->CNT = 0;
+    TIM8->CNT = 0;
+    TIM1->SR = 0;
+    TIM8->SR = 0;
+
+    bdshot_reception_1 = true;
+    bdshot_reception_2 = true;
+    bdshot_streams_done = 0;
+    bdshot_error = false;
+    bdshot_frame_error = false;
+    bdshot_statistics.recoveries++;
+
+    NVIC_EnableIRQ(DMA2_Stream6_IRQn);
+    NVIC_EnableIRQ(DMA2_Stream2_IRQn);
+}
+
+#if defined(USE_BDSHOT_PROBES)
+RAMFUNC static void BDshot_probe_record(BDshot_probe_stage stage, uint32_t cycles)
+{
+    volatile BDshot_probe_t *probe = &bdshot_probes[stage];
+
+    if (probe->count == 0 || cycles < probe->min)
+    {
+        probe->min = cycles;
+    }
+    if (cycles > probe->max)
+    {
+        probe->max = cycles;
+    }
+    probe->sum += cycles;
+    probe->count++;
+
+    // logarithmic histogram (bin = position of the highest set bit):
+    uint8_t bin = cycles == 0 ? 0 : 31 - __CLZ(cycles);
+    if (bin >= BDSHOT_PROBE_HISTOGRAM_BINS)
+    {
+        bin = BDSHOT_PROBE_HISTOGRAM_BINS - 1;
+    }
+    probe->histogram[bin]++;
+}
+#endif
+
+bool BDshot_set_DMA_mode(BDshot_DMA_mode tx_mode, BDshot_DMA_mode rx_mode)
+{
+    // Direct mode - every timer request makes DMA read memory (AHB bus matrix) and write to GPIO just after that.
+    // FIFO mode - DMA reads memory in advance so GPIO write isn't delayed by memory access (CPU can hold SRAM at that moment).
+    // Burst mode - memory is accessed 4 words at once, so there are 4 times less arbitrations on the bus matrix.
+    // Burst requires number of transfers to be a multiple of 4 (it is for BIT_BANGING_V1 and for reception):
+#if defined(BIT_BANGING_V2)
+    if (tx_mode == BDSHOT_DMA_FIFO_BURST)
+    {
+        return false;
+    }
+#endif
+    BDshot_DMA_mode_registers(tx_mode, &bdshot_tx_mburst, &bdshot_tx_fcr);
+    BDshot_DMA_mode_registers(rx_mode, &bdshot_rx_mburst, &bdshot_rx_fcr);
+    bdshot_dma_mode_set = true;
+
+    return true;
+}
+
+static void BDshot_DMA_mode_registers(BDshot_DMA_mode mode, uint32_t *mburst, uint32_t *fcr)
+{
+    switch (mode)
+    {
+    case BDSHOT_DMA_DIRECT:
+        *mburst = 0;
+        *fcr = 0;
+        break;
+    case BDSHOT_DMA_FIFO:
+        *mburst = 0;
+        *fcr = DMA_SxFCR_DMDIS | DMA_SxFCR_FEIE | ((BDSHOT_DMA_FIFO_THRESHOLD << DMA_SxFCR_FTH_Pos) & DMA_SxFCR_FTH);
+        break;
+    case BDSHOT_DMA_FIFO_BURST:
+        // for 32-bit data 4-beat burst is possible only with full FIFO threshold:
+        *mburst = DMA_SxCR_MBURST_0;
+        *fcr = DMA_SxFCR_DMDIS | DMA_SxFCR_FEIE | DMA_SxFCR_FTH_0 | DMA_SxFCR_FTH_1;
+        break;
+    }
+}
+
+RAMFUNC static void update_motors_rpm()
 {
     // BDshot bit banging reads whole GPIO register.
     // Now it's time to create BDshot responses from all motors (made of individual bits).
@@ -363,7 +798,7 @@ static void update_motors_rpm()
     read_BDshot_response(motor_4_response, 4);
 }
 
-static uint32_t get_BDshot_response(uint32_t raw_buffer[], const uint8_t motor_shift)
+RAMFUNC static uint32_t get_BDshot_response(uint32_t raw_buffer[], const uint8_t motor_shift)
 {
     // Reception starts just after transmission, so there is a lot of HIGH samples. Find first LOW bit:
 
@@ -417,7 +852,7 @@ static uint32_t get_BDshot_response(uint32_t raw_buffer[], const uint8_t motor_s
     }
 }
 
-static void read_BDshot_response(uint32_t value, uint8_t motor)
+RAMFUNC static void read_BDshot_response(uint32_t value, uint8_t motor)
 {
     // BDshot frame contain 21 bytes but first is always 0 (used only for detection).
     // Next 20 bits are 4 sets of 5-bits which are mapped with 4-bits real value.
@@ -448,6 +883,7 @@ static void read_BDshot_response(uint32_t value, uint8_t motor)
 
         motors_rpm[motor - 1] = ((decoded_value & 0x1FF0) >> 4) << (decoded_value >> 13);      // cut off CRC and add shifting - this is period in [us]
         motors_rpm[motor - 1] = 60 * 1000000 / motors_rpm[motor - 1] * 2 / MOTOR_POLES_NUMBER; // convert to RPM
+        motors_rpm_time[motor - 1] = DWT->CYCCNT;
         motors_error[motor - 1] = 0.9 * motors_error[motor - 1];                               // reduce motor error
     }
     else
@@ -456,7 +892,7 @@ static void read_BDshot_response(uint32_t value, uint8_t motor)
     }
 }
 
-static bool BDshot_check_checksum(uint16_t value)
+RAMFUNC static bool BDshot_check_checksum(uint16_t value)
 {
     // BDshot frame has 4 last bits CRC:
     if (((value ^ (value >> 4) ^ (value >> 8) ^ (value >> 12)) & 0x0F) == 0x0F)
@@ -1,10 +1,96 @@
-
-
 #ifndef BDSHOT_H_
 #define BDSHOT_H_
 #include "global_variables.h"
 
+// default configuration of both bit-banging DMA streams (direction, addresses and length are set before each transfer):
+#define BDSHOT_DMA_STREAM_CONFIG (DMA_SxCR_MSIZE_1 | DMA_SxCR_PSIZE_1 | DMA_SxCR_MINC | DMA_SxCR_DIR_0 | DMA_SxCR_TCIE | DMA_SxCR_TEIE | DMA_SxCR_DMEIE | DMA_SxCR_PL_0)
+
+typedef enum
+{
+    BDSHOT_DMA_DIRECT,     // direct mode - each request is a single beat from/to memory
+    BDSHOT_DMA_FIFO,       // FIFO enabled (BDSHOT_DMA_FIFO_THRESHOLD) - memory side is decoupled from timer requests
+    BDSHOT_DMA_FIFO_BURST, // FIFO enabled - memory is accessed with 4-beat bursts (full FIFO)
+} BDshot_DMA_mode;
+
+typedef enum
+{
+    BDSHOT_IDLE,   // no frame in progress - new one can be submitted
+    BDSHOT_TX,     // DShot frame is being transmitted
+    BDSHOT_RX,     // ESC response is being sampled
+    BDSHOT_DECODE, // responses are being decoded (motors_rpm update)
+} BDshot_state;
+
+typedef enum
+{
+    BDSHOT_FRAME_OK,      // frame sent and responses decoded (check motors_error for decoding result)
+    BDSHOT_FRAME_ERROR,   // DMA error - transfer error aborts the frame (pipeline re-initialized), direct mode error only marks it
+    BDSHOT_FRAME_TIMEOUT, // frame not completed within BDSHOT_FRAME_BUDGET_US - pipeline re-initialized
+} BDshot_frame_status;
+
+// called from DMA ISR (or from BDshot_submit() for aborted frames) - keep it short:
+typedef void (*BDshot_callback)(uint32_t frame_id, BDshot_frame_status status);
+
+typedef struct
+{
+    uint32_t frames_sent;       // frames started by BDshot_submit()
+    uint32_t frames_completed;  // frames with transmission and reception finished on both streams
+    uint32_t frames_skipped;    // BDshot_submit() called while previous frame was still in its time budget
+    uint32_t tx_errors;         // DMA transfer/direct mode errors during transmission
+    uint32_t rx_errors;         // DMA transfer/direct mode errors during reception
+    uint32_t fifo_errors;       // DMA FIFO errors (not critical - transfer is continued)
+    uint32_t stalls;            // frames not completed within BDSHOT_FRAME_BUDGET_US
+    uint32_t recoveries;        // how many times streams and timers were re-initialized
+    uint32_t budget_overruns;   // frames completed but later than BDSHOT_FRAME_BUDGET_US
+    uint32_t last_frame_cycles; // duration of the last completed frame [CPU cycles]
+    uint32_t max_frame_cycles;  // the longest completed frame [CPU cycles]
+} BDshot_statistics_t;
+
+typedef struct
+{
+    uint32_t ticks;              // scheduler interrupts
+    uint32_t frames_missed;      // ticks when frame couldn't be submitted (previous one still in progress)
+    uint32_t period_min_cycles;  // the shortest time between frames [CPU cycles]
+    uint32_t period_max_cycles;  // the longest time between frames [CPU cycles]
+    uint32_t jitter_max_cycles;  // max. deviation from BDSHOT_OUTPUT_RATE_HZ period [CPU cycles]
+    float jitter_mean_cycles;    // mean absolute deviation from BDSHOT_OUTPUT_RATE_HZ period [CPU cycles]
+} BDshot_scheduler_statistics_t;
+
+#if defined(USE_BDSHOT_PROBES)
+#define BDSHOT_PROBE_HISTOGRAM_BINS 20 // bin n counts durations from 2^n to 2^(n+1) - 1 [CPU cycles]
+
+typedef enum
+{
+    BDSHOT_PROBE_TX_1_4,         // TX start -> TC interrupt entry (DMA2_Stream6), ISR latency = this - BDSHOT_TX_TIME_US
+    BDSHOT_PROBE_TX_2_3,         // TX start -> TC interrupt entry (DMA2_Stream2), ISR latency = this - BDSHOT_TX_TIME_US
+    BDSHOT_PROBE_TURNAROUND_1_4, // TC interrupt entry -> RX enabled (DMA2_Stream6) - part of ~33 [us] gap before response
+    BDSHOT_PROBE_TURNAROUND_2_3, // TC interrupt entry -> RX enabled (DMA2_Stream2) - part of ~33 [us] gap before response
+    BDSHOT_PROBE_RX_1_4,         // RX enabled -> RX complete interrupt entry (DMA2_Stream6)
+    BDSHOT_PROBE_RX_2_3,         // RX enabled -> RX complete interrupt entry (DMA2_Stream2)
+    BDSHOT_PROBE_DECODE,         // the last RX complete interrupt entry -> responses decoded
+    BDSHOT_PROBE_STAGES,
+} BDshot_probe_stage;
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t min; // [CPU cycles]
+    uint32_t max; // [CPU cycles]
+    uint64_t sum; // [CPU cycles] mean = sum / count
+    uint32_t histogram[BDSHOT_PROBE_HISTOGRAM_BINS];
+} BDshot_probe_t;
+
+extern volatile BDshot_probe_t bdshot_probes[BDSHOT_PROBE_STAGES]; // updated in DMA ISRs
+#endif
+
+extern volatile BDshot_statistics_t bdshot_statistics; // updated in DMA ISRs
+extern volatile BDshot_scheduler_statistics_t bdshot_scheduler_statistics; // updated in TIM7 ISR (USE_BDSHOT_SCHEDULER)
+
 void update_motors();
+uint32_t BDshot_submit(const uint16_t motor_values[], BDshot_callback callback); // returns frame id (0 if previous frame is still in progress)
+BDshot_state BDshot_get_state();
+bool BDshot_frame_done(uint32_t frame_id);
+void BDshot_publish(const uint16_t motor_values[]);
 void preset_bb_BDshot_buffers();
+bool BDshot_set_DMA_mode(BDshot_DMA_mode tx_mode, BDshot_DMA_mode rx_mode);
 
-#endif /*BDSHOT_H_*/
\ No newline at end of file
+#endif /*BDSHOT_H_*/
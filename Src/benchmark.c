@@ -0,0 +1,328 @@
+/*
+ * benchmark.c
+ *
+ *  On-target measurements (DWT cycle counter). Results are saved in benchmark_results - watch them with debugger.
+ *  Enable them with USE_BENCHMARKS (global_constants.h).
+ */
+#include "stm32f4xx.h"
+#include <stddef.h>
+#include "global_constants.h"
+#include "global_variables.h"
+#include "bdshot.h"
+#include "filters.h"
+#include "benchmark.h"
+
+#define BENCHMARK_WORKLOAD_WORDS 256 // words copied by memory-bound workload (it has to be finished during BDshot transmission)
+
+static void benchmark_DMA_contention(benchmark_DMA_contention_t *result, BDshot_DMA_mode mode, RPM_filter_t *rpm_filter);
+static uint32_t memory_workload();
+static uint32_t RPM_filter_workload(RPM_filter_t *rpm_filter);
+static bool wait_for_BDshot_frame(uint32_t frames_completed);
+static void benchmark_code_placement(benchmark_code_placement_t *result, RPM_filter_t *rpm_filter);
+static void flash_ART(bool enable);
+static void benchmark_RPM_filter(benchmark_RPM_filter_t *result, RPM_filter_t *rpm_filter);
+static void benchmark_cycles_reset(benchmark_cycles_t *result);
+static void benchmark_cycles_add(benchmark_cycles_t *result, uint32_t cycles, uint16_t run);
+
+benchmark_results_t benchmark_results;
+
+static volatile uint32_t workload_source[BENCHMARK_WORKLOAD_WORDS];
+static volatile uint32_t workload_destination[BENCHMARK_WORKLOAD_WORDS];
+static volatile float rpm_filter_output; // keeps measured calls from being optimized out
+static const uint8_t block_sizes[BENCHMARK_BLOCK_SIZES] = {1, 4, 8, 32};
+
+// during measurements send 0 (1953) so motors are not spinning:
+static const uint16_t motor_stop_values[MOTORS_COUNT] = {1953, 1953, 1953, 1953};
+
+void run_benchmarks(RPM_filter_t *rpm_filter)
+{
+#if defined(USE_BDSHOT_SCHEDULER)
+    // frames are submitted directly by benchmarks:
+    NVIC_DisableIRQ(TIM7_IRQn);
+#endif
+
+    // memory placement (USE_DMA_SRAM2, USE_CCMRAM) - rebuild with other settings to compare contention:
+    benchmark_results.dma_buffers_address = (uint32_t)dshot_bb_buffer_1_4;
+    benchmark_results.rpm_filter_address = (uint32_t)rpm_filter;
+
+    benchmark_DMA_contention(&benchmark_results.dma_contention[BDSHOT_DMA_DIRECT], BDSHOT_DMA_DIRECT, rpm_filter);
+    benchmark_DMA_contention(&benchmark_results.dma_contention[BDSHOT_DMA_FIFO], BDSHOT_DMA_FIFO, rpm_filter);
+    benchmark_DMA_contention(&benchmark_results.dma_contention[BDSHOT_DMA_FIFO_BURST], BDSHOT_DMA_FIFO_BURST, rpm_filter);
+    BDshot_set_DMA_mode(BDSHOT_DMA_TX_MODE, BDSHOT_DMA_RX_MODE);
+
+    benchmark_code_placement(&benchmark_results.code_placement, rpm_filter);
+
+    benchmark_RPM_filter(&benchmark_results.rpm_filter, rpm_filter);
+
+#if defined(USE_BDSHOT_SCHEDULER)
+    NVIC_EnableIRQ(TIM7_IRQn);
+#endif
+}
+
+static void benchmark_DMA_contention(benchmark_DMA_contention_t *result, BDshot_DMA_mode mode, RPM_filter_t *rpm_filter)
+{
+    // The same memory-bound workload is run with DMA idle and during BDshot transmission.
+    // Both DMA streams access SRAM and GPIOs through the bus matrix so CPU has to wait for arbitration.
+
+    if (!BDshot_set_DMA_mode(mode, mode))
+    {
+        return; // mode not available for this bit-banging version
+    }
+
+    const uint32_t errors = bdshot_statistics.tx_errors + bdshot_statistics.rx_errors + bdshot_statistics.fifo_errors;
+    uint32_t cycles_idle_sum = 0;
+    uint32_t cycles_dma_sum = 0;
+    uint32_t filter_cycles_idle_sum = 0;
+    uint32_t filter_cycles_dma_sum = 0;
+    uint16_t runs = 0;
+
+    result->frame_cycles_min = UINT32_MAX;
+    result->frame_cycles_max = 0;
+
+    // let previous frame finish:
+    wait_for_BDshot_frame(bdshot_statistics.frames_completed);
+
+    for (uint16_t i = 0; i < BENCHMARK_RUNS; i++)
+    {
+        const uint32_t cycles_idle = memory_workload();
+        const uint32_t filter_cycles_idle = RPM_filter_workload(rpm_filter);
+
+        // both workloads are finished before transmission ends:
+        const uint32_t frames_completed = bdshot_statistics.frames_completed;
+        BDshot_submit(motor_stop_values, NULL);
+        const uint32_t cycles_dma = memory_workload();
+        const uint32_t filter_cycles_dma = RPM_filter_workload(rpm_filter);
+
+        if (wait_for_BDshot_frame(frames_completed))
+        {
+            cycles_idle_sum += cycles_idle;
+            cycles_dma_sum += cycles_dma;
+            filter_cycles_idle_sum += filter_cycles_idle;
+            filter_cycles_dma_sum += filter_cycles_dma;
+            runs++;
+
+            if (bdshot_statistics.last_frame_cycles < result->frame_cycles_min)
+            {
+                result->frame_cycles_min = bdshot_statistics.last_frame_cycles;
+            }
+            if (bdshot_statistics.last_frame_cycles > result->frame_cycles_max)
+            {
+                result->frame_cycles_max = bdshot_statistics.last_frame_cycles;
+            }
+        }
+    }
+
+    if (runs > 0)
+    {
+        result->cpu_cycles_idle = cycles_idle_sum / runs;
+        result->cpu_cycles_dma = cycles_dma_sum / runs;
+        result->cpu_slowdown = (float)cycles_dma_sum / cycles_idle_sum;
+        result->rpm_filter_cycles_idle = filter_cycles_idle_sum / runs;
+        result->rpm_filter_cycles_dma = filter_cycles_dma_sum / runs;
+    }
+    result->dma_errors = bdshot_statistics.tx_errors + bdshot_statistics.rx_errors + bdshot_statistics.fifo_errors - errors;
+}
+
+static uint32_t memory_workload()
+{
+    const uint32_t start = DWT->CYCCNT;
+
+    for (uint16_t i = 0; i < BENCHMARK_WORKLOAD_WORDS; i++)
+    {
+        workload_destination[i] = workload_source[i];
+    }
+
+    return DWT->CYCCNT - start;
+}
+
+static uint32_t RPM_filter_workload(RPM_filter_t *rpm_filter)
+{
+    static volatile float gyro_sample;
+    const uint32_t start = DWT->CYCCNT;
+
+    gyro_sample = RPM_filter_apply(rpm_filter, 0, gyro_sample);
+    gyro_sample = RPM_filter_apply(rpm_filter, 1, gyro_sample);
+    gyro_sample = RPM_filter_apply(rpm_filter, 2, gyro_sample);
+
+    return DWT->CYCCNT - start;
+}
+
+static bool wait_for_BDshot_frame(uint32_t frames_completed)
+{
+    const uint32_t start = DWT->CYCCNT;
+
+    while (bdshot_statistics.frames_completed == frames_completed)
+    {
+        if (DWT->CYCCNT - start > 2 * BDSHOT_FRAME_BUDGET_US * SYSTEM_CLOCK_MHZ)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void benchmark_code_placement(benchmark_code_placement_t *result, RPM_filter_t *rpm_filter)
+{
+    // Code in flash is executed with 5 wait states unless ART accelerator has it in cache (or prefetched).
+    // Code in SRAM (USE_RAMFUNC) doesn't depend on ART at all.
+    // Every second run is done after caches reset so max value shows the worst case:
+
+    result->rpm_filter_apply_address = (uint32_t)RPM_filter_apply;
+
+    flash_ART(false);
+    benchmark_cycles_reset(&result->art_off);
+    for (uint16_t i = 0; i < BENCHMARK_RUNS; i++)
+    {
+        benchmark_cycles_add(&result->art_off, RPM_filter_workload(rpm_filter), i);
+    }
+
+    flash_ART(true);
+    benchmark_cycles_reset(&result->art_on);
+    for (uint16_t i = 0; i < BENCHMARK_RUNS; i++)
+    {
+        if (i % 2 == 0)
+        {
+            flash_ART(false);
+            flash_ART(true);
+        }
+        benchmark_cycles_add(&result->art_on, RPM_filter_workload(rpm_filter), i);
+    }
+
+#if defined(USE_FLASH_ART)
+    flash_ART(true);
+#else
+    flash_ART(false);
+#endif
+}
+
+static void flash_ART(bool enable)
+{
+    if (enable)
+    {
+        FLASH->ACR |= FLASH_ACR_PRFTEN | FLASH_ACR_ICEN | FLASH_ACR_DCEN;
+    }
+    else
+    {
+        // disable and reset caches (reset is possible only for disabled caches):
+        FLASH->ACR &= ~(FLASH_ACR_PRFTEN | FLASH_ACR_ICEN | FLASH_ACR_DCEN);
+        FLASH->ACR |= FLASH_ACR_ICRST | FLASH_ACR_DCRST;
+        FLASH->ACR &= ~(FLASH_ACR_ICRST | FLASH_ACR_DCRST);
+    }
+}
+
+static void benchmark_RPM_filter(benchmark_RPM_filter_t *result, RPM_filter_t *rpm_filter)
+{
+    // input changes every run so filter state never settles (the same data for both backends):
+    float input = 1.f;
+
+#if defined(USE_RPM_FILTER_CMSIS)
+    result->backend = 1;
+#elif defined(USE_RPM_FILTER_Q31)
+    result->backend = 2;
+#elif defined(USE_RPM_FILTER_SVF)
+    result->backend = 3;
+#else
+    result->backend = 0;
+#endif
+#if defined(USE_RPM_FILTER_UNROLLED)
+    result->unrolled = true;
+#else
+    result->unrolled = false;
+#endif
+
+    benchmark_cycles_reset(&result->apply);
+    for (uint16_t i = 0; i < BENCHMARK_RUNS; i++)
+    {
+        input = -input * 0.99f;
+        const uint32_t start = DWT->CYCCNT;
+        rpm_filter_output = RPM_filter_apply(rpm_filter, i % 3, input);
+        benchmark_cycles_add(&result->apply, DWT->CYCCNT - start, i);
+    }
+
+    benchmark_cycles_reset(&result->apply_3_axes);
+    benchmark_cycles_reset(&result->apply3);
+    for (uint16_t i = 0; i < BENCHMARK_RUNS; i++)
+    {
+        input = -input * 0.99f;
+        float xyz[3] = {input, -input, 0.5f * input};
+
+        uint32_t start = DWT->CYCCNT;
+        xyz[0] = RPM_filter_apply(rpm_filter, 0, xyz[0]);
+        xyz[1] = RPM_filter_apply(rpm_filter, 1, xyz[1]);
+        xyz[2] = RPM_filter_apply(rpm_filter, 2, xyz[2]);
+        benchmark_cycles_add(&result->apply_3_axes, DWT->CYCCNT - start, i);
+
+        start = DWT->CYCCNT;
+        RPM_filter_apply3(rpm_filter, xyz);
+        benchmark_cycles_add(&result->apply3, DWT->CYCCNT - start, i);
+        rpm_filter_output = xyz[0] + xyz[1] + xyz[2];
+    }
+
+    float block[32]; // the longest of block_sizes
+    for (uint8_t size = 0; size < BENCHMARK_BLOCK_SIZES; size++)
+    {
+        result->block_sizes[size] = block_sizes[size];
+        benchmark_cycles_reset(&result->apply_block[size]);
+        for (uint16_t i = 0; i < BENCHMARK_RUNS; i++)
+        {
+            for (uint8_t n = 0; n < block_sizes[size]; n++)
+            {
+                input = -input * 0.99f;
+                block[n] = input;
+            }
+
+            const uint32_t start = DWT->CYCCNT;
+            RPM_filter_apply_block(rpm_filter, i % 3, block, block_sizes[size]);
+            benchmark_cycles_add(&result->apply_block[size], (DWT->CYCCNT - start) / block_sizes[size], i);
+            rpm_filter_output = block[0];
+        }
+    }
+
+    // rpms for which all notches are computed (without fading) - they change every run:
+    uint32_t motors_rpm_saved[MOTORS_COUNT];
+    for (uint8_t motor = 0; motor < MOTORS_COUNT; motor++)
+    {
+        motors_rpm_saved[motor] = motors_rpm[motor];
+    }
+
+    benchmark_cycles_reset(&result->update);
+    for (uint16_t i = 0; i < BENCHMARK_RUNS; i++)
+    {
+        for (uint8_t motor = 0; motor < MOTORS_COUNT; motor++)
+        {
+            motors_rpm[motor] = 6100 + 500 * motor + 10 * i;
+        }
+
+        const uint32_t start = DWT->CYCCNT;
+        RPM_filter_update(rpm_filter);
+        benchmark_cycles_add(&result->update, DWT->CYCCNT - start, i);
+    }
+
+    for (uint8_t motor = 0; motor < MOTORS_COUNT; motor++)
+    {
+        motors_rpm[motor] = motors_rpm_saved[motor];
+    }
+    RPM_filter_update(rpm_filter);
+}
+
+static void benchmark_cycles_reset(benchmark_cycles_t *result)
+{
+    result->min = UINT32_MAX;
+    result->max = 0;
+    result->mean = 0;
+}
+
+static void benchmark_cycles_add(benchmark_cycles_t *result, uint32_t cycles, uint16_t run)
+{
+    // run is counted from 0:
+    if (cycles < result->min)
+    {
+        result->min = cycles;
+    }
+    if (cycles > result->max)
+    {
+        result->max = cycles;
+    }
+    result->mean += ((float)cycles - result->mean) / (run + 1);
+}
@@ -0,0 +1,68 @@
+/*
+ * benchmark.h
+ *
+ *  On-target measurements (DWT cycle counter). Results are saved in benchmark_results - watch them with debugger.
+ */
+
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "global_constants.h"
+#include "filters.h"
+
+#define BENCHMARK_BLOCK_SIZES 4 // block sizes measured for RPM_filter_apply_block() (e.g. IMU FIFO bursts)
+
+typedef struct
+{
+    uint32_t min;  // [CPU cycles]
+    uint32_t max;  // [CPU cycles]
+    float mean;    // [CPU cycles]
+} benchmark_cycles_t;
+
+typedef struct
+{
+    uint32_t cpu_cycles_idle;        // memory-bound workload without DMA traffic [CPU cycles]
+    uint32_t cpu_cycles_dma;         // the same workload during BDshot transmission [CPU cycles]
+    float cpu_slowdown;              // cpu_cycles_dma / cpu_cycles_idle
+    uint32_t rpm_filter_cycles_idle; // RPM_filter_apply() for 3 axes without DMA traffic [CPU cycles]
+    uint32_t rpm_filter_cycles_dma;  // RPM_filter_apply() for 3 axes during BDshot transmission [CPU cycles]
+    uint32_t frame_cycles_min;       // the shortest BDshot frame [CPU cycles]
+    uint32_t frame_cycles_max;       // the longest BDshot frame [CPU cycles] (max - min is the jitter of timer paced DMA requests and ISRs)
+    uint32_t dma_errors;             // transfer, direct mode and FIFO errors during measurement
+} benchmark_DMA_contention_t;
+
+typedef struct
+{
+    uint32_t rpm_filter_apply_address; // >= 0x2000 0000 - executed from SRAM (USE_RAMFUNC), otherwise from flash
+    benchmark_cycles_t art_off;        // RPM_filter_apply() for 3 axes with ART accelerator disabled
+    benchmark_cycles_t art_on;         // RPM_filter_apply() for 3 axes with ART accelerator enabled (max - after caches reset)
+} benchmark_code_placement_t;
+
+typedef struct
+{
+    uint8_t backend;          // 0 - float, 1 - CMSIS float (USE_RPM_FILTER_CMSIS), 2 - CMSIS Q31 (USE_RPM_FILTER_Q31), 3 - SVF (USE_RPM_FILTER_SVF) - rebuild to compare backends
+    bool unrolled;            // USE_RPM_FILTER_UNROLLED (straight-line notches) - rebuild to compare with loop over active notches
+    benchmark_cycles_t apply;        // RPM_filter_apply() for one axis (one gyro sample)
+    benchmark_cycles_t apply_3_axes; // RPM_filter_apply() called for each axis (one xyz gyro sample)
+    benchmark_cycles_t apply3;       // RPM_filter_apply3() (one xyz gyro sample)
+    benchmark_cycles_t update;       // RPM_filter_update() with all notches in use (rebuild without USE_FAST_TRIGONOMETRY to compare)
+    uint8_t block_sizes[BENCHMARK_BLOCK_SIZES];            // samples in RPM_filter_apply_block() call
+    benchmark_cycles_t apply_block[BENCHMARK_BLOCK_SIZES]; // RPM_filter_apply_block() per sample (one axis) for each block size
+} benchmark_RPM_filter_t;
+
+typedef struct
+{
+    benchmark_DMA_contention_t dma_contention[3]; // for each BDshot_DMA_mode (used for transmission and reception)
+    uint32_t dma_buffers_address;                 // SRAM1 (0x2000 0000) or SRAM2 (0x2001 C000) - see USE_DMA_SRAM2
+    uint32_t rpm_filter_address;                  // SRAM1 (0x2000 0000) or CCM RAM (0x1000 0000) - see USE_CCMRAM
+    benchmark_code_placement_t code_placement;    // rebuild without USE_RAMFUNC to compare flash and SRAM execution
+    benchmark_RPM_filter_t rpm_filter;            // RPM filter cost with DMA idle
+} benchmark_results_t;
+
+extern benchmark_results_t benchmark_results;
+
+void run_benchmarks(RPM_filter_t *rpm_filter);
+
+#endif /* BENCHMARK_H_ */
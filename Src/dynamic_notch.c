@@ -0,0 +1,249 @@
+/*
+ * dynamic_notch.c
+ *
+ *  Samples are windowed when they come (dynamic_notch_apply()) and analyzed when the whole window is ready.
+ *  Analysis is split into small steps - each dynamic_notch_update() call does one of them:
+ *  - FFT of one axis (one arm_rfft_fast_f32() call),
+ *  - squared magnitudes or peak search for DYNAMIC_NOTCH_BINS_PER_UPDATE bins,
+ *  - retuning DYNAMIC_NOTCH_COUNT notches of one axis.
+ *  So CPU time of each call is bounded and a whole window is analyzed in 3 * (3 + 2 * bins / DYNAMIC_NOTCH_BINS_PER_UPDATE) calls.
+ */
+#include "stm32f4xx.h"
+#include <math.h>
+#include "global_constants.h"
+#include "filters.h"
+#include "dynamic_notch.h"
+
+static void dynamic_notch_magnitude(dynamic_notch_t *filter);
+static void dynamic_notch_peaks(dynamic_notch_t *filter);
+static void dynamic_notch_tune(dynamic_notch_t *filter);
+
+static float hann_window[DYNAMIC_NOTCH_FFT_LENGTH];
+
+void dynamic_notch_init(dynamic_notch_t *filter, uint16_t sampling_frequency_Hz)
+{
+	arm_rfft_fast_init_f32(&(filter->fft), DYNAMIC_NOTCH_FFT_LENGTH);
+
+	for (uint16_t i = 0; i < DYNAMIC_NOTCH_FFT_LENGTH; i++)
+	{
+		hann_window[i] = 0.5f - 0.5f * cosf(2.f * (float)M_PI * i / (DYNAMIC_NOTCH_FFT_LENGTH - 1));
+	}
+
+	filter->sampling_frequency_Hz = sampling_frequency_Hz;
+	const float bin_width = (float)sampling_frequency_Hz / DYNAMIC_NOTCH_FFT_LENGTH;
+	filter->min_bin = DYNAMIC_NOTCH_MIN_HZ / bin_width;
+	filter->max_bin = DYNAMIC_NOTCH_MAX_HZ / bin_width + 1;
+	// peak search needs neighbors of each bin (bin 0 and N/2 are packed together by rfft so they are not used):
+	if (filter->min_bin < 2)
+	{
+		filter->min_bin = 2;
+	}
+	if (filter->max_bin > DYNAMIC_NOTCH_FFT_LENGTH / 2 - 2)
+	{
+		filter->max_bin = DYNAMIC_NOTCH_FFT_LENGTH / 2 - 2;
+	}
+
+	// spread notches over the range until first peaks are found:
+	for (uint8_t axis = 0; axis < 3; axis++)
+	{
+		for (uint8_t notch = 0; notch < DYNAMIC_NOTCH_COUNT; notch++)
+		{
+			const float frequency = DYNAMIC_NOTCH_MIN_HZ + (notch + 0.5f) * (DYNAMIC_NOTCH_MAX_HZ - DYNAMIC_NOTCH_MIN_HZ) / DYNAMIC_NOTCH_COUNT;
+			biquad_filter_init(&(filter->notches[axis][notch]), BIQUAD_NOTCH, frequency, DYNAMIC_NOTCH_Q, sampling_frequency_Hz);
+		}
+	}
+
+	filter->sample_index = 0;
+	filter->capture_buffer = 0;
+	filter->analysis_pending = false;
+	filter->step = DYNAMIC_NOTCH_WAIT;
+	filter->axis = 0;
+	filter->windows_analyzed = 0;
+	filter->windows_dropped = 0;
+}
+
+RAMFUNC void dynamic_notch_apply(dynamic_notch_t *filter, float xyz[3])
+{
+	// capture input (it is the noise which should be found):
+	const float window = hann_window[filter->sample_index];
+	for (uint8_t axis = 0; axis < 3; axis++)
+	{
+		filter->capture[filter->capture_buffer][axis][filter->sample_index] = window * xyz[axis];
+	}
+
+	filter->sample_index++;
+	if (filter->sample_index >= DYNAMIC_NOTCH_FFT_LENGTH)
+	{
+		filter->sample_index = 0;
+		if (filter->analysis_pending)
+		{
+			// keep analyzed buffer and overwrite this window:
+			filter->windows_dropped++;
+		}
+		else
+		{
+			filter->capture_buffer ^= 1;
+			filter->analysis_pending = true;
+		}
+	}
+
+	for (uint8_t axis = 0; axis < 3; axis++)
+	{
+		for (uint8_t notch = 0; notch < DYNAMIC_NOTCH_COUNT; notch++)
+		{
+			xyz[axis] = biquad_filter_apply_DF1(&(filter->notches[axis][notch]), xyz[axis]);
+		}
+	}
+}
+
+void dynamic_notch_update(dynamic_notch_t *filter)
+{
+	switch (filter->step)
+	{
+	case DYNAMIC_NOTCH_WAIT:
+		if (filter->analysis_pending)
+		{
+			filter->axis = 0;
+			filter->step = DYNAMIC_NOTCH_FFT;
+		}
+		break;
+
+	case DYNAMIC_NOTCH_FFT:
+		// input buffer is used as working memory by FFT (it's not needed later):
+		arm_rfft_fast_f32(&(filter->fft), filter->capture[filter->capture_buffer ^ 1][filter->axis], filter->spectrum, 0);
+		filter->bin = filter->min_bin - 1;
+		filter->step = DYNAMIC_NOTCH_MAGNITUDE;
+		break;
+
+	case DYNAMIC_NOTCH_MAGNITUDE:
+		dynamic_notch_magnitude(filter);
+		break;
+
+	case DYNAMIC_NOTCH_PEAKS:
+		dynamic_notch_peaks(filter);
+		break;
+
+	case DYNAMIC_NOTCH_TUNE:
+		dynamic_notch_tune(filter);
+
+		filter->axis++;
+		if (filter->axis < 3)
+		{
+			filter->step = DYNAMIC_NOTCH_FFT;
+		}
+		else
+		{
+			filter->windows_analyzed++;
+			filter->analysis_pending = false;
+			filter->step = DYNAMIC_NOTCH_WAIT;
+		}
+		break;
+	}
+}
+
+static void dynamic_notch_magnitude(dynamic_notch_t *filter)
+{
+	// rfft output is {Re(0), Re(N/2), Re(1), Im(1), ...} - magnitude of bin k is saved in spectrum[k].
+	// It overwrites only data of bins k/2 and lower which were already used (bins are processed in ascending order):
+	uint16_t last_bin = filter->bin + DYNAMIC_NOTCH_BINS_PER_UPDATE - 1;
+	if (last_bin > filter->max_bin + 1)
+	{
+		last_bin = filter->max_bin + 1;
+	}
+
+	for (uint16_t bin = filter->bin; bin <= last_bin; bin++)
+	{
+		const float re = filter->spectrum[2 * bin];
+		const float im = filter->spectrum[2 * bin + 1];
+		filter->spectrum[bin] = re * re + im * im;
+	}
+
+	filter->bin = last_bin + 1;
+	if (filter->bin > filter->max_bin + 1)
+	{
+		for (uint8_t peak = 0; peak < DYNAMIC_NOTCH_COUNT; peak++)
+		{
+			filter->peak_magnitude[peak] = 0;
+		}
+		filter->bin = filter->min_bin;
+		filter->step = DYNAMIC_NOTCH_PEAKS;
+	}
+}
+
+static void dynamic_notch_peaks(dynamic_notch_t *filter)
+{
+	// local maxima are kept in descending order of magnitude:
+	const float *magnitude = filter->spectrum;
+	uint16_t last_bin = filter->bin + DYNAMIC_NOTCH_BINS_PER_UPDATE - 1;
+	if (last_bin > filter->max_bin)
+	{
+		last_bin = filter->max_bin;
+	}
+
+	for (uint16_t bin = filter->bin; bin <= last_bin; bin++)
+	{
+		if (magnitude[bin] <= magnitude[bin - 1] || magnitude[bin] < magnitude[bin + 1] || magnitude[bin] <= filter->peak_magnitude[DYNAMIC_NOTCH_COUNT - 1])
+		{
+			continue;
+		}
+
+		// parabolic interpolation between bins:
+		const float denominator = magnitude[bin - 1] - 2 * magnitude[bin] + magnitude[bin + 1];
+		const float offset = denominator < 0 ? 0.5f * (magnitude[bin - 1] - magnitude[bin + 1]) / denominator : 0;
+		const float frequency = (bin + offset) * filter->sampling_frequency_Hz / DYNAMIC_NOTCH_FFT_LENGTH;
+
+		uint8_t peak = DYNAMIC_NOTCH_COUNT - 1;
+		while (peak > 0 && magnitude[bin] > filter->peak_magnitude[peak - 1])
+		{
+			filter->peak_magnitude[peak] = filter->peak_magnitude[peak - 1];
+			filter->peak_frequency[peak] = filter->peak_frequency[peak - 1];
+			peak--;
+		}
+		filter->peak_magnitude[peak] = magnitude[bin];
+		filter->peak_frequency[peak] = frequency;
+	}
+
+	filter->bin = last_bin + 1;
+	if (filter->bin > filter->max_bin)
+	{
+		filter->step = DYNAMIC_NOTCH_TUNE;
+	}
+}
+
+static void dynamic_notch_tune(dynamic_notch_t *filter)
+{
+	// peaks are matched from the strongest one - each moves the nearest notch not moved yet, so a notch keeps following
+	// its own peak when other peaks appear, disappear or change their order. Notches without a peak stay where they are:
+	bool tuned[DYNAMIC_NOTCH_COUNT] = {false};
+
+	for (uint8_t peak = 0; peak < DYNAMIC_NOTCH_COUNT && filter->peak_magnitude[peak] > 0; peak++)
+	{
+		const float peak_frequency = filter->peak_frequency[peak];
+		uint8_t nearest = DYNAMIC_NOTCH_COUNT;
+		float nearest_distance = 0;
+
+		for (uint8_t notch = 0; notch < DYNAMIC_NOTCH_COUNT; notch++)
+		{
+			const float distance = fabsf(filter->notches[filter->axis][notch].frequency - peak_frequency);
+			if (!tuned[notch] && (nearest == DYNAMIC_NOTCH_COUNT || distance < nearest_distance))
+			{
+				nearest = notch;
+				nearest_distance = distance;
+			}
+		}
+		tuned[nearest] = true;
+
+		biquad_Filter_t *biquad = &(filter->notches[filter->axis][nearest]);
+		float frequency = biquad->frequency + DYNAMIC_NOTCH_SMOOTHING * (peak_frequency - biquad->frequency);
+
+		if (frequency < DYNAMIC_NOTCH_MIN_HZ)
+		{
+			frequency = DYNAMIC_NOTCH_MIN_HZ;
+		}
+		if (frequency > DYNAMIC_NOTCH_MAX_HZ)
+		{
+			frequency = DYNAMIC_NOTCH_MAX_HZ;
+		}
+		biquad_filter_update(biquad, BIQUAD_NOTCH, frequency, DYNAMIC_NOTCH_Q, filter->sampling_frequency_Hz);
+	}
+}
@@ -0,0 +1,51 @@
+/*
+ * dynamic_notch.h
+ *
+ *  Notches following the strongest non-motor noise peaks (frame resonances, prop-wash) found with FFT of gyro samples.
+ *  Enable it with USE_DYNAMIC_NOTCH (global_constants.h).
+ */
+
+#ifndef DYNAMIC_NOTCH_H_
+#define DYNAMIC_NOTCH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "global_constants.h"
+#include "filters.h"
+#include "arm_math.h"
+
+typedef enum
+{
+	DYNAMIC_NOTCH_WAIT,		 // waiting for a full window of samples
+	DYNAMIC_NOTCH_FFT,		 // FFT of the analyzed axis
+	DYNAMIC_NOTCH_MAGNITUDE, // squared magnitudes of the next DYNAMIC_NOTCH_BINS_PER_UPDATE bins
+	DYNAMIC_NOTCH_PEAKS,	 // peak search in the next DYNAMIC_NOTCH_BINS_PER_UPDATE bins
+	DYNAMIC_NOTCH_TUNE,		 // notches of the analyzed axis are moved to found peaks
+} dynamic_notch_step;
+
+typedef struct
+{
+	biquad_Filter_t notches[3][DYNAMIC_NOTCH_COUNT];		// notches for each axis (each one follows the nearest peak)
+	float capture[2][3][DYNAMIC_NOTCH_FFT_LENGTH];			// windowed samples - one buffer is filled while the other one is analyzed
+	float spectrum[DYNAMIC_NOTCH_FFT_LENGTH];				// FFT of the analyzed axis (next squared magnitudes of bins)
+	arm_rfft_fast_instance_f32 fft;							// CMSIS-DSP real FFT of DYNAMIC_NOTCH_FFT_LENGTH samples
+	float peak_frequency[DYNAMIC_NOTCH_COUNT];				// the strongest peaks of the analyzed axis [Hz]
+	float peak_magnitude[DYNAMIC_NOTCH_COUNT];				// their squared magnitudes (0 - peak not found)
+	uint16_t sampling_frequency_Hz;							// fs of filtered samples [Hz]
+	uint16_t min_bin;										// the first bin of peak search (DYNAMIC_NOTCH_MIN_HZ)
+	uint16_t max_bin;										// the last bin of peak search (DYNAMIC_NOTCH_MAX_HZ)
+	uint16_t sample_index;									// next sample in the filled buffer
+	uint16_t bin;											// next bin of the current step
+	uint8_t capture_buffer;									// buffer being filled
+	uint8_t axis;											// analyzed axis
+	bool analysis_pending;									// other buffer is full and waits for (or is under) analysis
+	dynamic_notch_step step;								// analysis step done by the next dynamic_notch_update()
+	uint32_t windows_analyzed;								// windows with all axes analyzed
+	uint32_t windows_dropped;								// windows not analyzed because previous analysis wasn't finished
+} dynamic_notch_t;
+
+void dynamic_notch_init(dynamic_notch_t *filter, uint16_t sampling_frequency_Hz);
+RAMFUNC void dynamic_notch_apply(dynamic_notch_t *filter, float xyz[3]);
+void dynamic_notch_update(dynamic_notch_t *filter);
+
+#endif /* DYNAMIC_NOTCH_H_ */
@@ -0,0 +1,106 @@
+/*
+ * filter_pipeline.c
+ *
+ *  Stages are dispatched with switch on their type (no function pointers) and each of them filters all axes at once.
+ */
+#include "stm32f4xx.h"
+#include "global_constants.h"
+#include "filters.h"
+#include "dynamic_notch.h"
+#include "filter_pipeline.h"
+
+static int8_t filter_pipeline_add(filter_pipeline_t *pipeline, filter_stage_type type, void *filter);
+
+void filter_pipeline_init(filter_pipeline_t *pipeline)
+{
+	pipeline->stages_count = 0;
+}
+
+int8_t filter_pipeline_add_RPM(filter_pipeline_t *pipeline, RPM_filter_t *filter)
+{
+	return filter_pipeline_add(pipeline, FILTER_STAGE_RPM, filter);
+}
+
+int8_t filter_pipeline_add_dynamic_notch(filter_pipeline_t *pipeline, dynamic_notch_t *filter)
+{
+	return filter_pipeline_add(pipeline, FILTER_STAGE_DYNAMIC_NOTCH, filter);
+}
+
+int8_t filter_pipeline_add_biquad(filter_pipeline_t *pipeline, biquad_Filter_t filters[3])
+{
+	return filter_pipeline_add(pipeline, FILTER_STAGE_BIQUAD, filters);
+}
+
+int8_t filter_pipeline_add_PT1(filter_pipeline_t *pipeline, PT1_Filter_t filters[3])
+{
+	return filter_pipeline_add(pipeline, FILTER_STAGE_PT1, filters);
+}
+
+static int8_t filter_pipeline_add(filter_pipeline_t *pipeline, filter_stage_type type, void *filter)
+{
+	if (pipeline->stages_count >= FILTER_PIPELINE_MAX_STAGES)
+	{
+		return -1;
+	}
+
+	filter_stage_t *stage = &(pipeline->stages[pipeline->stages_count]);
+	stage->type = type;
+	stage->enabled = true;
+	switch (type)
+	{
+	case FILTER_STAGE_RPM:
+		stage->rpm = filter;
+		break;
+	case FILTER_STAGE_DYNAMIC_NOTCH:
+		stage->dynamic_notch = filter;
+		break;
+	case FILTER_STAGE_BIQUAD:
+		stage->biquad = filter;
+		break;
+	case FILTER_STAGE_PT1:
+		stage->pt1 = filter;
+		break;
+	}
+
+	return pipeline->stages_count++;
+}
+
+void filter_pipeline_enable(filter_pipeline_t *pipeline, uint8_t stage, bool enabled)
+{
+	if (stage < pipeline->stages_count)
+	{
+		pipeline->stages[stage].enabled = enabled;
+	}
+}
+
+RAMFUNC void filter_pipeline_apply(filter_pipeline_t *pipeline, float xyz[3])
+{
+	for (uint8_t i = 0; i < pipeline->stages_count; i++)
+	{
+		const filter_stage_t *stage = &(pipeline->stages[i]);
+		if (!stage->enabled)
+		{
+			continue;
+		}
+
+		switch (stage->type)
+		{
+		case FILTER_STAGE_RPM:
+			RPM_filter_apply3(stage->rpm, xyz);
+			break;
+		case FILTER_STAGE_DYNAMIC_NOTCH:
+			dynamic_notch_apply(stage->dynamic_notch, xyz);
+			break;
+		case FILTER_STAGE_BIQUAD:
+			xyz[0] = biquad_filter_apply_DF1(&(stage->biquad[0]), xyz[0]);
+			xyz[1] = biquad_filter_apply_DF1(&(stage->biquad[1]), xyz[1]);
+			xyz[2] = biquad_filter_apply_DF1(&(stage->biquad[2]), xyz[2]);
+			break;
+		case FILTER_STAGE_PT1:
+			xyz[0] = PT1_filter_apply(&(stage->pt1[0]), xyz[0]);
+			xyz[1] = PT1_filter_apply(&(stage->pt1[1]), xyz[1]);
+			xyz[2] = PT1_filter_apply(&(stage->pt1[2]), xyz[2]);
+			break;
+		}
+	}
+}
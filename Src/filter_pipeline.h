@@ -0,0 +1,53 @@
+/*
+ * filter_pipeline.h
+ *
+ *  Chain of filter stages (e.g. RPM filter -> dynamic notch -> 2x biquad LPF -> PT1) applied to xyz sample in one pass.
+ *  Filters are kept by user (static storage) - pipeline keeps only pointers to them.
+ */
+
+#ifndef FILTER_PIPELINE_H_
+#define FILTER_PIPELINE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "global_constants.h"
+#include "filters.h"
+#include "dynamic_notch.h"
+
+typedef enum
+{
+	FILTER_STAGE_RPM,			// RPM_filter_t (all axes)
+	FILTER_STAGE_DYNAMIC_NOTCH, // dynamic_notch_t (all axes)
+	FILTER_STAGE_BIQUAD,		// biquad_Filter_t[3] (one for each axis)
+	FILTER_STAGE_PT1,			// PT1_Filter_t[3] (one for each axis)
+} filter_stage_type;
+
+typedef struct
+{
+	filter_stage_type type;
+	bool enabled; // disabled stage is bypassed (its state is not updated)
+	union
+	{
+		RPM_filter_t *rpm;
+		dynamic_notch_t *dynamic_notch;
+		biquad_Filter_t *biquad;
+		PT1_Filter_t *pt1;
+	};
+} filter_stage_t;
+
+typedef struct
+{
+	filter_stage_t stages[FILTER_PIPELINE_MAX_STAGES]; // applied in order of adding
+	uint8_t stages_count;
+} filter_pipeline_t;
+
+void filter_pipeline_init(filter_pipeline_t *pipeline);
+// each function returns index of the new stage (-1 if pipeline is full):
+int8_t filter_pipeline_add_RPM(filter_pipeline_t *pipeline, RPM_filter_t *filter);
+int8_t filter_pipeline_add_dynamic_notch(filter_pipeline_t *pipeline, dynamic_notch_t *filter);
+int8_t filter_pipeline_add_biquad(filter_pipeline_t *pipeline, biquad_Filter_t filters[3]);
+int8_t filter_pipeline_add_PT1(filter_pipeline_t *pipeline, PT1_Filter_t filters[3]);
+void filter_pipeline_enable(filter_pipeline_t *pipeline, uint8_t stage, bool enabled);
+RAMFUNC void filter_pipeline_apply(filter_pipeline_t *pipeline, float xyz[3]);
+
+#endif /* FILTER_PIPELINE_H_ */
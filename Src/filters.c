@@ -10,8 +10,69 @@
 #include "global_variables.h"
 #include "filters.h"
 
-static void biquad_filter_update(biquad_Filter_t *filter, biquad_Filter_type filter_type, float filter_frequency_Hz, float quality_factor, uint16_t sampling_frequency_Hz);
-static void biquad_filter_copy_coefficients(biquad_Filter_t *copy_from_filter, biquad_Filter_t *copy_to_filter);
+static void biquad_coefficients_update(biquad_coefficients_t *coefficients, biquad_Filter_type filter_type, float filter_frequency_Hz, float quality_factor, uint16_t sampling_frequency_Hz);
+static void biquad_coefficients_compute(biquad_coefficients_t *coefficients, biquad_Filter_type filter_type, float omega, float quality_factor);
+static void RPM_filter_update_motor(RPM_filter_t *filter, uint8_t motor);
+static float RPM_filter_motor_frequency(RPM_filter_t *filter, uint8_t motor);
+#if defined(USE_RPM_ALIAS_FOLDING)
+static float RPM_filter_alias_frequency(const RPM_filter_t *filter, float frequency);
+#endif
+static void RPM_filter_update_active_notches(RPM_filter_t *filter);
+static void RPM_filter_publish(RPM_filter_t *filter);
+static inline RPM_filter_bank_t *RPM_filter_update_bank(RPM_filter_t *filter);
+static FORCE_INLINE const RPM_filter_bank_t *RPM_filter_apply_bank(RPM_filter_t *filter);
+static void RPM_notch_coefficients_compute(RPM_notch_coefficients_t *coefficients, float omega, float quality_factor);
+static FORCE_INLINE float RPM_notch_apply(const RPM_notch_coefficients_t *coefficients, float weight, uint8_t active_notch, float state[4], bool primed, float input);
+#if defined(USE_FAST_TRIGONOMETRY)
+static void fast_sin_cos(float omega, float *sn, float *cs);
+#endif
+static FORCE_INLINE float biquad_DF1_step(const biquad_coefficients_t *coefficients, float state[4], float input);
+#if defined(USE_RPM_FILTER_UNROLLED)
+// X-macros calling X(motor, harmonic) for each notch - code is generated for configured MOTORS_COUNT and RPM_MAX_HARMONICS:
+#if MOTORS_COUNT > 8 || RPM_MAX_HARMONICS > 8
+#error "USE_RPM_FILTER_UNROLLED supports up to 8 motors and 8 harmonics"
+#endif
+#define RPM_HARMONICS_1(X, motor) X(motor, 0)
+#define RPM_HARMONICS_2(X, motor) RPM_HARMONICS_1(X, motor) X(motor, 1)
+#define RPM_HARMONICS_3(X, motor) RPM_HARMONICS_2(X, motor) X(motor, 2)
+#define RPM_HARMONICS_4(X, motor) RPM_HARMONICS_3(X, motor) X(motor, 3)
+#define RPM_HARMONICS_5(X, motor) RPM_HARMONICS_4(X, motor) X(motor, 4)
+#define RPM_HARMONICS_6(X, motor) RPM_HARMONICS_5(X, motor) X(motor, 5)
+#define RPM_HARMONICS_7(X, motor) RPM_HARMONICS_6(X, motor) X(motor, 6)
+#define RPM_HARMONICS_8(X, motor) RPM_HARMONICS_7(X, motor) X(motor, 7)
+#define RPM_MOTORS_1(HARMONICS, X) HARMONICS(X, 0)
+#define RPM_MOTORS_2(HARMONICS, X) RPM_MOTORS_1(HARMONICS, X) HARMONICS(X, 1)
+#define RPM_MOTORS_3(HARMONICS, X) RPM_MOTORS_2(HARMONICS, X) HARMONICS(X, 2)
+#define RPM_MOTORS_4(HARMONICS, X) RPM_MOTORS_3(HARMONICS, X) HARMONICS(X, 3)
+#define RPM_MOTORS_5(HARMONICS, X) RPM_MOTORS_4(HARMONICS, X) HARMONICS(X, 4)
+#define RPM_MOTORS_6(HARMONICS, X) RPM_MOTORS_5(HARMONICS, X) HARMONICS(X, 5)
+#define RPM_MOTORS_7(HARMONICS, X) RPM_MOTORS_6(HARMONICS, X) HARMONICS(X, 6)
+#define RPM_MOTORS_8(HARMONICS, X) RPM_MOTORS_7(HARMONICS, X) HARMONICS(X, 7)
+#define RPM_CONCAT(a, b) RPM_CONCAT_EXPANDED(a, b)
+#define RPM_CONCAT_EXPANDED(a, b) a##b
+#define RPM_FOR_EACH_NOTCH(X) RPM_CONCAT(RPM_MOTORS_, MOTORS_COUNT)(RPM_CONCAT(RPM_HARMONICS_, RPM_MAX_HARMONICS), X)
+#endif
+#if defined(USE_RPM_FILTER_SVF)
+static FORCE_INLINE float svf_notch_step(const svf_coefficients_t *coefficients, float state[2], float input);
+#endif
+#if defined(RPM_FILTER_CASCADE)
+static void RPM_filter_fold_coefficients(RPM_filter_bank_t *bank, uint8_t notch, uint8_t stage);
+#endif
+#if defined(USE_RPM_FILTER_UNROLLED)
+static FORCE_INLINE void RPM_unrolled_notch(RPM_filter_t *filter, const RPM_filter_bank_t *bank, uint8_t motor, uint8_t harmonic, uint8_t axis, float *value, uint32_t *applied_mask);
+static FORCE_INLINE void RPM_unrolled_notch3(RPM_filter_t *filter, const RPM_filter_bank_t *bank, uint8_t motor, uint8_t harmonic, float *x, float *y, float *z, uint32_t *applied_mask);
+#endif
+#if defined(USE_RPM_FILTER_CMSIS)
+static FORCE_INLINE arm_biquad_casd_df1_inst_f32 *RPM_filter_cascade(RPM_filter_t *filter, const RPM_filter_bank_t *bank, uint8_t axis, float input);
+static RAMFUNC void RPM_filter_cascade_remap(RPM_filter_t *filter, const RPM_filter_bank_t *bank, uint8_t axis, float input);
+#elif defined(USE_RPM_FILTER_Q31)
+static FORCE_INLINE arm_biquad_cas_df1_32x64_ins_q31 *RPM_filter_cascade(RPM_filter_t *filter, const RPM_filter_bank_t *bank, uint8_t axis, q31_t input);
+static RAMFUNC void RPM_filter_cascade_remap(RPM_filter_t *filter, const RPM_filter_bank_t *bank, uint8_t axis, q31_t input);
+#endif
+#if defined(USE_RPM_FILTER_Q31)
+static FORCE_INLINE q31_t RPM_filter_to_q31(float value);
+static FORCE_INLINE float RPM_filter_from_q31(q31_t value);
+#endif
 
 void biquad_filter_init(biquad_Filter_t *filter, biquad_Filter_type filter_type, float filter_frequency_Hz, float quality_factor, uint16_t sampling_frequency_Hz)
 {
@@ -24,15 +85,40 @@ void biquad_filter_init(biquad_Filter_t *filter, biquad_Filter_type filter_type,
 	filter->y2 = 0;
 }
 
-static void biquad_filter_update(biquad_Filter_t *filter, biquad_Filter_type filter_type, float filter_frequency_Hz, float quality_factor, uint16_t sampling_frequency_Hz)
+void biquad_filter_update(biquad_Filter_t *filter, biquad_Filter_type filter_type, float filter_frequency_Hz, float quality_factor, uint16_t sampling_frequency_Hz)
 {
+	biquad_coefficients_t coefficients;
+	biquad_coefficients_update(&coefficients, filter_type, filter_frequency_Hz, quality_factor, sampling_frequency_Hz);
+
 	// save filter info:
 	filter->frequency = filter_frequency_Hz;
 	filter->Q_factor = quality_factor;
-	const float omega = 2.f * M_PI * filter_frequency_Hz / sampling_frequency_Hz;
+	filter->a0 = 1;
+	filter->a1 = coefficients.a1;
+	filter->a2 = coefficients.a2;
+	filter->b0 = coefficients.b0;
+	filter->b1 = coefficients.b1;
+	filter->b2 = coefficients.b2;
+}
+
+static void biquad_coefficients_update(biquad_coefficients_t *coefficients, biquad_Filter_type filter_type, float filter_frequency_Hz, float quality_factor, uint16_t sampling_frequency_Hz)
+{
+	// M_PI is double - cast it so everything is computed by FPU:
+	biquad_coefficients_compute(coefficients, filter_type, 2.f * (float)M_PI * filter_frequency_Hz / sampling_frequency_Hz, quality_factor);
+}
+
+static void biquad_coefficients_compute(biquad_coefficients_t *coefficients, biquad_Filter_type filter_type, float omega, float quality_factor)
+{
+	// omega is normalized angular frequency (2 * PI * f / fs):
+#if defined(USE_FAST_TRIGONOMETRY)
+	float sn;
+	float cs;
+	fast_sin_cos(omega, &sn, &cs);
+#else
 	const float sn = sinf(omega);
 	const float cs = cosf(omega);
-	const float alpha = sn / (2.0f * filter->Q_factor);
+#endif
+	const float alpha = sn / (2.0f * quality_factor);
 
 	// implementation from datasheet:https://www.ti.com/lit/an/slaa447/slaa447.pdf <-- not everything good
 	// or even better: http://shepazu.github.io/Audio-EQ-Cookbook/audio-eq-cookbook.html <-- probably resource for above
@@ -65,56 +151,58 @@ static void biquad_filter_update(biquad_Filter_t *filter, biquad_Filter_type fil
 	In this datasheet conversion from s -> z domain is done with Bilinear transform with pre-warping
 	*/
 
-	filter->a0 = 1 + alpha;
+	const float a0 = 1 + alpha;
 	switch (filter_type)
 	{
 	case BIQUAD_LPF:
 
-		filter->b0 = (1 - cs) * 0.5f;
-		filter->b1 = 1 - cs;
-		filter->b2 = filter->b0;
-		filter->a1 = -2 * cs;
-		filter->a2 = 1 - alpha;
+		coefficients->b0 = (1 - cs) * 0.5f;
+		coefficients->b1 = 1 - cs;
+		coefficients->b2 = coefficients->b0;
+		coefficients->a1 = -2 * cs;
+		coefficients->a2 = 1 - alpha;
 		break;
 	case BIQUAD_NOTCH:
-		filter->b0 = 1;
-		filter->b1 = -2 * cs;
-		filter->b2 = 1;
-		filter->a1 = filter->b1;
-		filter->a2 = 1 - alpha;
+		coefficients->b0 = 1;
+		coefficients->b1 = -2 * cs;
+		coefficients->b2 = 1;
+		coefficients->a1 = coefficients->b1;
+		coefficients->a2 = 1 - alpha;
 		break;
 	case BIQUAD_BPF:
-		filter->b0 = alpha;
-		filter->b1 = 0;
-		filter->b2 = -alpha;
-		filter->a1 = -2 * cs;
-		filter->a2 = 1 - alpha;
+	default:
+		coefficients->b0 = alpha;
+		coefficients->b1 = 0;
+		coefficients->b2 = -alpha;
+		coefficients->a1 = -2 * cs;
+		coefficients->a2 = 1 - alpha;
 		break;
 	}
 
-	// oust a0 coefficient:
-	filter->b0 /= filter->a0;
-	filter->b1 /= filter->a0;
-	filter->b2 /= filter->a0;
-	filter->a1 /= filter->a0;
-	filter->a2 /= filter->a0;
+	// oust a0 coefficient (one division instead of five):
+	const float a0_inverse = 1.f / a0;
+	coefficients->b0 *= a0_inverse;
+	coefficients->b1 *= a0_inverse;
+	coefficients->b2 *= a0_inverse;
+	coefficients->a1 *= a0_inverse;
+	coefficients->a2 *= a0_inverse;
 }
 
-float biquad_filter_apply_DF1(biquad_Filter_t *filter, float input)
+#if defined(USE_FAST_TRIGONOMETRY)
+static void fast_sin_cos(float omega, float *sn, float *cs)
 {
-	// compute result:
-	const float result = filter->b0 * input + filter->b1 * filter->x1 + filter->b2 * filter->x2 - filter->a1 * filter->y1 - filter->a2 * filter->y2;
-
-	// shift x1 to x2, input to x1:
-	filter->x2 = filter->x1;
-	filter->x1 = input;
+	// valid for omega = 0 ... PI (any frequency below Nyquist). With x = omega - PI/2 (|x| <= PI/2):
+	// sin(omega) = cos(x) and cos(omega) = -sin(x) - Taylor series up to x^12 and x^11 have error < 1e-7 there.
+	// Compared with double precision libm, for 50-432 [Hz] at 900 [Hz] sampling (float omega):
+	// - max. error of sin is 4.0e-7 and of cos is 2.7e-7 (sinf/cosf: 4.1e-7 and 3.0e-7),
+	// - notch center frequency (from cos) is shifted by max. 1.5e-4 [Hz], which is 0.15% of the narrowest notch bandwidth (50 [Hz] / Q = 500).
+	const float x = omega - (float)M_PI_2;
+	const float x2 = x * x;
 
-	// shift y1 to y2, result to y1:
-	filter->y2 = filter->y1;
-	filter->y1 = result;
-
-	return result;
+	*sn = 1.f + x2 * (-1.f / 2 + x2 * (1.f / 24 + x2 * (-1.f / 720 + x2 * (1.f / 40320 + x2 * (-1.f / 3628800 + x2 * (1.f / 479001600))))));
+	*cs = -x * (1.f + x2 * (-1.f / 6 + x2 * (1.f / 120 + x2 * (-1.f / 5040 + x2 * (1.f / 362880 + x2 * (-1.f / 39916800))))));
 }
+#endif
 
 float biquad_filter_apply_DF2(biquad_Filter_t *filter, float input)
 {
@@ -128,102 +216,889 @@ float biquad_filter_apply_DF2(biquad_Filter_t *filter, float input)
 	return result;
 }
 
-static void biquad_filter_copy_coefficients(biquad_Filter_t *copy_from_filter, biquad_Filter_t *copy_to_filter)
+void PT1_filter_init(PT1_Filter_t *filter, float cutoff_frequency_Hz, uint16_t sampling_frequency_Hz)
+{
+	const float RC = 1.f / (2.f * (float)M_PI * cutoff_frequency_Hz);
+	const float dt = 1.f / sampling_frequency_Hz;
+
+	filter->k = dt / (RC + dt);
+	filter->output = 0;
+}
+
+static FORCE_INLINE float biquad_DF1_step(const biquad_coefficients_t *coefficients, float state[4], float input)
+{
+	// the same as biquad_filter_apply_DF1() but with separated coefficients and state {x1, x2, y1, y2}:
+	const float result = coefficients->b0 * input + coefficients->b1 * state[0] + coefficients->b2 * state[1] - coefficients->a1 * state[2] - coefficients->a2 * state[3];
+
+	state[1] = state[0];
+	state[0] = input;
+	state[3] = state[2];
+	state[2] = result;
+
+	return result;
+}
+
+#if defined(USE_RPM_FILTER_SVF)
+static FORCE_INLINE float svf_notch_step(const svf_coefficients_t *coefficients, float state[2], float input)
 {
+	// v1 - band-pass, v2 - low-pass, notch = low-pass + high-pass = input - k * v1. State {ic1eq, ic2eq}:
+	const float v3 = input - state[1];
+	const float v1 = coefficients->a1 * state[0] + coefficients->a2 * v3;
+	const float v2 = state[1] + coefficients->a2 * state[0] + coefficients->a3 * v3;
 
-	copy_to_filter->a0 = copy_from_filter->a0;
-	copy_to_filter->a1 = copy_from_filter->a1;
-	copy_to_filter->a2 = copy_from_filter->a2;
+	state[0] = 2 * v1 - state[0];
+	state[1] = 2 * v2 - state[1];
 
-	copy_to_filter->b0 = copy_from_filter->b0;
-	copy_to_filter->b1 = copy_from_filter->b1;
-	copy_to_filter->b2 = copy_from_filter->b2;
+	return input - coefficients->k * v1;
 }
+#endif
 
 void RPM_filter_init(RPM_filter_t *filter, uint16_t sampling_frequency_Hz)
 {
-	filter->harmonics = RPM_MAX_HARMONICS;
-	filter->q_factor = RPM_Q_FACTOR;
+	filter->bank_index = 0;
+	filter->sampling_frequency_Hz = 0;
+	RPM_filter_set_sampling_frequency(filter, sampling_frequency_Hz);
+
+	for (uint8_t harmonic = 0; harmonic < RPM_MAX_HARMONICS; harmonic++)
+	{
+		filter->q_factor[harmonic] = RPM_Q_FACTOR;
+	}
 	const float default_freq = 100; // only for initialization doesn't really matter
+	RPM_filter_bank_t *bank = RPM_filter_update_bank(filter);
 
-	// initialize notch filters:
+	// initialize notch filters (the same coefficients for each axis):
+	for (uint8_t motor = 0; motor < MOTORS_COUNT; motor++)
+	{
+		for (uint8_t harmonic = 0; harmonic < RPM_MAX_HARMONICS; harmonic++)
+		{
+			RPM_notch_coefficients_compute(&(bank->coefficients[motor][harmonic]), filter->omega_per_Hz * default_freq, filter->q_factor[harmonic]);
+			filter->tuned_frequency[motor][harmonic] = default_freq;
+			filter->retune_skips[motor][harmonic] = 0;
+			bank->weight[motor][harmonic] = 1;
+		}
+	}
+	filter->retunes_done = 0;
+	filter->retunes_skipped = 0;
+	filter->update_motor = 0;
+#if defined(USE_RPM_ESTIMATOR)
+	for (uint8_t motor = 0; motor < MOTORS_COUNT; motor++)
+	{
+		filter->estimators[motor].frequency = 0;
+		filter->estimators[motor].rate = 0;
+		filter->estimators[motor].measurement_time = 0;
+	}
+#endif
+	RPM_filter_set_harmonics(filter, RPM_MAX_HARMONICS, RPM_HARMONICS_MASK); // publishes notches (all banks are the same after it)
+
+	// set previous values as 0:
 	for (uint8_t axis = 0; axis < 3; axis++)
 	{
 		for (uint8_t motor = 0; motor < MOTORS_COUNT; motor++)
 		{
 			for (uint8_t harmonic = 0; harmonic < RPM_MAX_HARMONICS; harmonic++)
 			{
-				biquad_filter_init(&(filter->notch_filters[axis][motor][harmonic]), BIQUAD_NOTCH, default_freq, filter->q_factor, sampling_frequency_Hz);
-				filter->weight[axis][motor][harmonic] = 1;
+				for (uint8_t i = 0; i < 4; i++)
+				{
+					filter->state[axis][motor][harmonic][i] = 0;
+				}
 			}
 		}
+		filter->applied_mask[axis] = 0;
+	}
+
+#if defined(USE_RPM_FILTER_CMSIS)
+	// all axes share coefficients, state layout {x1, x2, y1, y2} is the same as CMSIS uses.
+	// Cascades have no stages yet - the first apply adds active notches (RPM_filter_cascade_remap()):
+	for (uint8_t axis = 0; axis < 3; axis++)
+	{
+		arm_biquad_cascade_df1_init_f32(&(filter->cmsis_cascade[axis]), 0, filter->banks[0].cmsis_coefficients, &(filter->state[axis][0][0][0]));
 	}
+#elif defined(USE_RPM_FILTER_Q31)
+	for (uint8_t axis = 0; axis < 3; axis++)
+	{
+		arm_biquad_cas_df1_32x64_init_q31(&(filter->q31_cascade[axis]), 0, filter->banks[0].q31_coefficients, filter->q31_state[axis], 1);
+	}
+#endif
 }
 
 void RPM_filter_update(RPM_filter_t *filter)
 {
-	const uint8_t sec_in_min = 60; // for conversion from Hz to rpm
-	float frequency;			   // frequency for filtering
-	// each motor introduces its own frequency (with harmonics) but for every axes noises are the same;
-
+	// each motor introduces its own frequency (with harmonics) but for every axes noises are the same so coefficients are computed once:
+#if defined(USE_RPM_UPDATE_ROUND_ROBIN)
+	// one motor per call - cost of each call is the same and each notch is at most MOTORS_COUNT calls old:
+	RPM_filter_update_motor(filter, filter->update_motor);
+	filter->update_motor = (filter->update_motor + 1) % MOTORS_COUNT;
+#else
 	for (uint8_t motor = 0; motor < MOTORS_COUNT; motor++)
 	{
-		for (uint8_t harmonic = 0; harmonic < RPM_MAX_HARMONICS; harmonic++)
+		RPM_filter_update_motor(filter, motor);
+	}
+#endif
+
+	RPM_filter_update_active_notches(filter);
+	RPM_filter_publish(filter);
+}
+
+static void RPM_filter_update_motor(RPM_filter_t *filter, uint8_t motor)
+{
+	const float motor_frequency = RPM_filter_motor_frequency(filter, motor);
+	RPM_filter_bank_t *bank = RPM_filter_update_bank(filter);
+	float frequency; // frequency for filtering
+
+	for (uint8_t i = 0; i < filter->active_harmonics_count; i++)
+	{
+		const uint8_t harmonic = filter->active_harmonics[i];
+		const float q_factor = filter->q_factor[harmonic];
+		frequency = motor_frequency * (harmonic + 1);
+#if defined(USE_RPM_ALIAS_FOLDING)
+		frequency = RPM_filter_alias_frequency(filter, frequency);
+#endif
+		if (frequency > filter->min_frequency_Hz)
 		{
-			frequency = (float)motors_rpm[motor] * (harmonic + 1) / sec_in_min;
-			if (frequency > RPM_MIN_FREQUENCY_HZ)
+			if (frequency < filter->max_frequency_Hz)
 			{
-				if (frequency < MAX_FREQUENCY_FOR_FILTERING)
+				// notch is much narrower than its distance to others, so small frequency changes (hover, no new telemetry) don't need new coefficients at once
+				// but steady detune would limit notch depth - it is removed after RPM_RETUNE_MAX_SKIPS updates:
+				const float detune = fabsf(frequency - filter->tuned_frequency[motor][harmonic]);
+				if (detune > RPM_RETUNE_THRESHOLD * filter->tuned_frequency[motor][harmonic] / q_factor ||
+					(detune > 0 && ++filter->retune_skips[motor][harmonic] >= RPM_RETUNE_MAX_SKIPS))
+				{
+					RPM_notch_coefficients_compute(&(bank->coefficients[motor][harmonic]), filter->omega_per_Hz * frequency, q_factor);
+					filter->tuned_frequency[motor][harmonic] = frequency;
+					filter->retune_skips[motor][harmonic] = 0;
+					filter->retunes_done++;
+				}
+				else
+				{
+					filter->retunes_skipped++;
+				}
+
+				// fade out if reaching minimal frequency:
+				if (frequency < filter->fade_frequency_Hz)
 				{
-					// each axis has the same noises from motors, so compute it once and next copy values:
-					biquad_filter_update(&(filter->notch_filters[0][motor][harmonic]), BIQUAD_NOTCH, frequency, filter->q_factor, FREQUENCY_OF_SAMPLING_HZ);
-					biquad_filter_copy_coefficients(&(filter->notch_filters[0][motor][harmonic]), &(filter->notch_filters[1][motor][harmonic]));
-					biquad_filter_copy_coefficients(&(filter->notch_filters[0][motor][harmonic]), &(filter->notch_filters[2][motor][harmonic]));
-
-					// fade out if reaching minimal frequency:
-					if (frequency < (RPM_MIN_FREQUENCY_HZ + RPM_FADE_RANGE_HZ))
-					{
-						filter->weight[0][motor][harmonic] = (float)(frequency - RPM_MIN_FREQUENCY_HZ) / (RPM_FADE_RANGE_HZ);
-						filter->weight[1][motor][harmonic] = filter->weight[0][motor][harmonic];
-						filter->weight[2][motor][harmonic] = filter->weight[0][motor][harmonic];
-					}
-					else
-					{
-						filter->weight[0][motor][harmonic] = 1;
-						filter->weight[1][motor][harmonic] = 1;
-						filter->weight[2][motor][harmonic] = 1;
-					}
+					bank->weight[motor][harmonic] = (frequency - filter->min_frequency_Hz) * filter->fade_range_inverse;
 				}
 				else
 				{
-					filter->weight[0][motor][harmonic] = 0;
-					filter->weight[1][motor][harmonic] = 0;
-					filter->weight[2][motor][harmonic] = 0;
+					bank->weight[motor][harmonic] = 1;
 				}
 			}
 			else
 			{
-				frequency = RPM_MIN_FREQUENCY_HZ;
+				bank->weight[motor][harmonic] = 0;
+			}
+		}
+		else
+		{
+			bank->weight[motor][harmonic] = 0;
+		}
+	}
+}
+
+#if defined(RPM_FILTER_CASCADE)
+static void RPM_filter_fold_coefficients(RPM_filter_bank_t *bank, uint8_t notch, uint8_t stage)
+{
+	// weighted notch w * B/A + (1 - w) is a single biquad (w * B + (1 - w) * A) / A, so blending costs nothing in apply.
+	// Numerator is computed as A + w * (B - A) - differences are exact and b1 stays a1 (notch), so zeros do not drift from poles
+	// when they almost cancel (low weight, Q = 500 at low f / fs). CMSIS computes y = b0*x0 + b1*x1 + b2*x2 + a1*y1 + a2*y2 so denominator coefficients are negated:
+	const biquad_coefficients_t *coefficients = &(bank->coefficients[0][notch]);
+	const float weight = bank->weight[0][notch];
+	const float folded[5] = {
+		1 + weight * (coefficients->b0 - 1),
+		coefficients->a1 + weight * (coefficients->b1 - coefficients->a1),
+		coefficients->a2 + weight * (coefficients->b2 - coefficients->a2),
+		-coefficients->a1,
+		-coefficients->a2,
+	};
+	const uint8_t offset = 5 * stage;
+
+	for (uint8_t i = 0; i < 5; i++)
+	{
+#if defined(USE_RPM_FILTER_CMSIS)
+		bank->cmsis_coefficients[offset + i] = folded[i];
+#else
+		// Q1.30 (|coefficient| < 2):
+		bank->q31_coefficients[offset + i] = (q31_t)(folded[i] * 1073741824.f);
+#endif
+	}
+}
+#endif
+
+#if defined(USE_RPM_FILTER_Q31)
+static FORCE_INLINE q31_t RPM_filter_to_q31(float value)
+{
+	// saturate to RPM_FILTER_Q31_RANGE:
+	const float scaled = value * (2147483648.f / RPM_FILTER_Q31_RANGE);
+	if (scaled >= 2147483648.f)
+	{
+		return INT32_MAX;
+	}
+	if (scaled <= -2147483648.f)
+	{
+		return INT32_MIN;
+	}
+	return (q31_t)scaled;
+}
 
-				filter->weight[0][motor][harmonic] = 0;
-				filter->weight[1][motor][harmonic] = 0;
-				filter->weight[2][motor][harmonic] = 0;
+static FORCE_INLINE float RPM_filter_from_q31(q31_t value)
+{
+	return (float)value * (RPM_FILTER_Q31_RANGE / 2147483648.f);
+}
+#endif
+
+static float RPM_filter_motor_frequency(RPM_filter_t *filter, uint8_t motor)
+{
+	const uint8_t sec_in_min = 60; // for conversion from Hz to rpm
+
+#if defined(USE_RPM_ESTIMATOR)
+	// eRPM period is sent with 9-bit mantissa (coarse steps at high rpm) and only once per BDshot frame.
+	// Alpha-beta tracker smooths these steps and predicts frequency for now (loop can be faster than telemetry):
+	RPM_estimator_t *estimator = &(filter->estimators[motor]);
+	const uint32_t cycles_per_second = SYSTEM_CLOCK_MHZ * 1000000;
+
+	// it can be called with interrupts already disabled (e.g. from ISR section) - restore previous state:
+	const uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	const uint32_t rpm = motors_rpm[motor];
+	const uint32_t measurement_time = motors_rpm_time[motor];
+	__set_PRIMASK(primask);
+
+	if (measurement_time != estimator->measurement_time)
+	{
+		const float measured_frequency = (float)rpm / sec_in_min;
+		const float dt = (float)(measurement_time - estimator->measurement_time) / cycles_per_second;
+
+		if (measured_frequency <= filter->min_frequency_Hz || estimator->frequency <= filter->min_frequency_Hz || dt > RPM_ESTIMATOR_MAX_PREDICTION_US * 1e-6f)
+		{
+			// start tracking again (motor stopped or telemetry was lost):
+			estimator->frequency = measured_frequency;
+			estimator->rate = 0;
+		}
+		else
+		{
+			const float predicted_frequency = estimator->frequency + estimator->rate * dt;
+			const float residual = measured_frequency - predicted_frequency;
+			estimator->frequency = predicted_frequency + RPM_ESTIMATOR_ALPHA * residual;
+			estimator->rate += RPM_ESTIMATOR_BETA * residual / dt;
+		}
+		estimator->measurement_time = measurement_time;
+	}
+
+	float prediction_time = (float)(DWT->CYCCNT - estimator->measurement_time) / cycles_per_second;
+	if (prediction_time > RPM_ESTIMATOR_MAX_PREDICTION_US * 1e-6f)
+	{
+		prediction_time = RPM_ESTIMATOR_MAX_PREDICTION_US * 1e-6f;
+	}
+
+	return estimator->frequency + estimator->rate * prediction_time;
+#else
+	(void)filter;
+	return (float)motors_rpm[motor] / sec_in_min;
+#endif
+}
+
+#if defined(USE_RPM_ALIAS_FOLDING)
+static float RPM_filter_alias_frequency(const RPM_filter_t *filter, float frequency)
+{
+	// harmonic above Nyquist frequency is sampled as a tone at |f - n * fs| (it is not removed by gyro's LPF so it has to be notched there).
+	// Aliases close to 0 or Nyquist are handled as any other notch (faded or turned off):
+	const float sampling_frequency = filter->sampling_frequency_Hz;
+	if (frequency < 0.5f * sampling_frequency)
+	{
+		return frequency;
+	}
+
+	frequency -= sampling_frequency * floorf(frequency * filter->sampling_period_s);
+	if (frequency > 0.5f * sampling_frequency)
+	{
+		frequency = sampling_frequency - frequency;
+	}
+	return frequency;
+}
+#endif
+
+void RPM_filter_set_harmonics(RPM_filter_t *filter, uint8_t harmonics, uint8_t harmonics_mask)
+{
+	// harmonics above runtime count are not filtered even if they are in the mask:
+	if (harmonics > RPM_MAX_HARMONICS)
+	{
+		harmonics = RPM_MAX_HARMONICS;
+	}
+	filter->harmonics = harmonics;
+	filter->harmonics_mask = harmonics_mask & ((1 << harmonics) - 1);
+	filter->active_harmonics_count = 0;
+
+	for (uint8_t harmonic = 0; harmonic < RPM_MAX_HARMONICS; harmonic++)
+	{
+		const bool active = filter->harmonics_mask & (1 << harmonic);
+		if (active)
+		{
+			filter->active_harmonics[filter->active_harmonics_count] = harmonic;
+			filter->active_harmonics_count++;
+		}
+
+		for (uint8_t motor = 0; motor < MOTORS_COUNT; motor++)
+		{
+			if (active)
+			{
+				// retune on the next update:
+				filter->tuned_frequency[motor][harmonic] = 0;
+			}
+			else
+			{
+				RPM_filter_update_bank(filter)->weight[motor][harmonic] = 0;
 			}
 		}
 	}
+
+	RPM_filter_update_active_notches(filter);
+	RPM_filter_publish(filter);
 }
 
-float RPM_filter_apply(RPM_filter_t *filter, uint8_t axis, float input)
+void RPM_filter_set_q_factor(RPM_filter_t *filter, uint8_t harmonic, float q_factor)
 {
-	float result = input;
+	if (harmonic >= RPM_MAX_HARMONICS)
+	{
+		return;
+	}
+	filter->q_factor[harmonic] = q_factor;
+
+	// retune on the next update:
+	for (uint8_t motor = 0; motor < MOTORS_COUNT; motor++)
+	{
+		filter->tuned_frequency[motor][harmonic] = 0;
+	}
+}
+
+void RPM_filter_set_sampling_frequency(RPM_filter_t *filter, uint16_t sampling_frequency_Hz)
+{
+	const bool refresh = filter->sampling_frequency_Hz != 0; // not needed during RPM_filter_init()
+
+	filter->sampling_frequency_Hz = sampling_frequency_Hz;
+	filter->sampling_period_s = 1.f / sampling_frequency_Hz;
+	filter->omega_per_Hz = 2.f * (float)M_PI * filter->sampling_period_s;
+	filter->max_frequency_Hz = MAX_FREQUENCY_FOR_FILTERING_RATIO * sampling_frequency_Hz;
+	filter->min_frequency_Hz = RPM_MIN_FREQUENCY_HZ;
+	filter->fade_frequency_Hz = RPM_MIN_FREQUENCY_HZ + RPM_FADE_RANGE_HZ;
+	filter->fade_range_inverse = 1.f / RPM_FADE_RANGE_HZ;
+
+	if (!refresh)
+	{
+		return;
+	}
 
+	// every notch is mistuned now - recompute all of them (also in round-robin mode):
 	for (uint8_t motor = 0; motor < MOTORS_COUNT; motor++)
 	{
 		for (uint8_t harmonic = 0; harmonic < RPM_MAX_HARMONICS; harmonic++)
 		{
-			result = filter->weight[axis][motor][harmonic] * biquad_filter_apply_DF1(&(filter->notch_filters[axis][motor][harmonic]), result) + (1 - filter->weight[axis][motor][harmonic]) * result;
+			filter->tuned_frequency[motor][harmonic] = 0;
 		}
+		RPM_filter_update_motor(filter, motor);
 	}
+	RPM_filter_update_active_notches(filter);
+	RPM_filter_publish(filter);
+}
+
+static void RPM_filter_update_active_notches(RPM_filter_t *filter)
+{
+	// natural order is kept (notches in series commute only if their order doesn't change between samples):
+	RPM_filter_bank_t *bank = RPM_filter_update_bank(filter);
+	const float *weights = bank->weight[0];
+	uint8_t count = 0;
+#if defined(RPM_FILTER_CASCADE)
+	uint32_t active_mask = 0;
+#endif
+
+	for (uint8_t notch = 0; notch < MOTORS_COUNT * RPM_MAX_HARMONICS; notch++)
+	{
+		const float weight = weights[notch];
+		if (weight > 0)
+		{
+			bank->active_notches[count] = weight < 1 ? notch | RPM_NOTCH_FADING : notch;
+#if defined(RPM_FILTER_CASCADE)
+			// only active notches are cascade stages (inactive ones would be identity filters):
+			RPM_filter_fold_coefficients(bank, notch, count);
+			active_mask |= 1UL << notch;
+#endif
+			count++;
+		}
+	}
+
+	bank->active_count = count;
+#if defined(RPM_FILTER_CASCADE)
+	bank->active_mask = active_mask;
+#endif
+}
+
+static void RPM_filter_publish(RPM_filter_t *filter)
+{
+#if defined(USE_RPM_FILTER_DOUBLE_BUFFER)
+	// apply functions (higher priority context, e.g. gyro ISR) switch to prepared bank with one byte store - all its writes have to be finished before:
+	__DMB();
+	filter->bank_index ^= 1;
+
+	// next changes are made on a copy of the published bank (apply functions only read it meanwhile):
+	filter->banks[filter->bank_index ^ 1] = filter->banks[filter->bank_index];
+#else
+	(void)filter;
+#endif
+}
+
+static inline RPM_filter_bank_t *RPM_filter_update_bank(RPM_filter_t *filter)
+{
+	// without double buffering it is the same bank as apply functions use:
+	return &(filter->banks[filter->bank_index ^ (RPM_FILTER_BANKS - 1)]);
+}
+
+static FORCE_INLINE const RPM_filter_bank_t *RPM_filter_apply_bank(RPM_filter_t *filter)
+{
+	return &(filter->banks[filter->bank_index]);
+}
+
+#if defined(USE_RPM_FILTER_CMSIS)
+static FORCE_INLINE arm_biquad_casd_df1_inst_f32 *RPM_filter_cascade(RPM_filter_t *filter, const RPM_filter_bank_t *bank, uint8_t axis, float input)
+{
+	// cascade of the axis with stages of published bank (states are moved if active notches changed since the last apply):
+	if (filter->applied_mask[axis] != bank->active_mask)
+	{
+		RPM_filter_cascade_remap(filter, bank, axis, input);
+	}
+	filter->cmsis_cascade[axis].pCoeffs = (float *)bank->cmsis_coefficients; // only read by library
+	return &(filter->cmsis_cascade[axis]);
+}
+
+static RAMFUNC void RPM_filter_cascade_remap(RPM_filter_t *filter, const RPM_filter_bank_t *bank, uint8_t axis, float input)
+{
+	// active notches changed - states of the remaining ones are moved to their new stages. Added notches get input history
+	// of their place in the cascade as both x and y history (the same as passing it through - folded notch starts at its gain 1
+	// away from its frequency, without a transient). Stages and masks are in natural order:
+	float(*state)[4] = filter->state[axis][0];
+	float previous_state[MOTORS_COUNT * RPM_MAX_HARMONICS][4];
+	const uint32_t previous_mask = filter->applied_mask[axis];
+	const uint32_t active_mask = bank->active_mask;
+	const uint8_t previous_count = filter->cmsis_cascade[axis].numStages;
+	uint8_t previous_stage = 0;
+	uint8_t stage = 0;
+
+	for (uint8_t i = 0; i < previous_count; i++)
+	{
+		for (uint8_t k = 0; k < 4; k++)
+		{
+			previous_state[i][k] = state[i][k];
+		}
+	}
+
+	// {x1, x2} of the cascade input (first stage keeps it, steady input is assumed without stages):
+	float history[2] = {input, input};
+	if (previous_count > 0)
+	{
+		history[0] = previous_state[0][0];
+		history[1] = previous_state[0][1];
+	}
+
+	for (uint8_t notch = 0; notch < MOTORS_COUNT * RPM_MAX_HARMONICS; notch++)
+	{
+		const uint32_t notch_bit = 1UL << notch;
+		if (active_mask & notch_bit)
+		{
+			if (previous_mask & notch_bit)
+			{
+				for (uint8_t k = 0; k < 4; k++)
+				{
+					state[stage][k] = previous_state[previous_stage][k];
+				}
+			}
+			else
+			{
+				state[stage][0] = history[0];
+				state[stage][1] = history[1];
+				state[stage][2] = history[0];
+				state[stage][3] = history[1];
+			}
+			// output history is input history of the next stage:
+			history[0] = state[stage][2];
+			history[1] = state[stage][3];
+			stage++;
+		}
+		if (previous_mask & notch_bit)
+		{
+			previous_stage++;
+		}
+	}
+
+	filter->cmsis_cascade[axis].numStages = stage;
+	filter->applied_mask[axis] = active_mask;
+}
+#elif defined(USE_RPM_FILTER_Q31)
+static FORCE_INLINE arm_biquad_cas_df1_32x64_ins_q31 *RPM_filter_cascade(RPM_filter_t *filter, const RPM_filter_bank_t *bank, uint8_t axis, q31_t input)
+{
+	if (filter->applied_mask[axis] != bank->active_mask)
+	{
+		RPM_filter_cascade_remap(filter, bank, axis, input);
+	}
+	filter->q31_cascade[axis].pCoeffs = (q31_t *)bank->q31_coefficients; // only read by library
+	return &(filter->q31_cascade[axis]);
+}
+
+static RAMFUNC void RPM_filter_cascade_remap(RPM_filter_t *filter, const RPM_filter_bank_t *bank, uint8_t axis, q31_t input)
+{
+	// the same as float version - x is Q31 and y is Q1.63 in state (history is kept as y):
+	q63_t(*state)[4] = (q63_t(*)[4])filter->q31_state[axis];
+	q63_t previous_state[MOTORS_COUNT * RPM_MAX_HARMONICS][4];
+	const uint32_t previous_mask = filter->applied_mask[axis];
+	const uint32_t active_mask = bank->active_mask;
+	const uint8_t previous_count = filter->q31_cascade[axis].numStages;
+	uint8_t previous_stage = 0;
+	uint8_t stage = 0;
+
+	for (uint8_t i = 0; i < previous_count; i++)
+	{
+		for (uint8_t k = 0; k < 4; k++)
+		{
+			previous_state[i][k] = state[i][k];
+		}
+	}
+
+	q63_t history[2] = {(q63_t)input * 4294967296LL, (q63_t)input * 4294967296LL};
+	if (previous_count > 0)
+	{
+		history[0] = previous_state[0][0] * 4294967296LL;
+		history[1] = previous_state[0][1] * 4294967296LL;
+	}
+
+	for (uint8_t notch = 0; notch < MOTORS_COUNT * RPM_MAX_HARMONICS; notch++)
+	{
+		const uint32_t notch_bit = 1UL << notch;
+		if (active_mask & notch_bit)
+		{
+			if (previous_mask & notch_bit)
+			{
+				for (uint8_t k = 0; k < 4; k++)
+				{
+					state[stage][k] = previous_state[previous_stage][k];
+				}
+			}
+			else
+			{
+				state[stage][0] = (q31_t)(history[0] >> 32);
+				state[stage][1] = (q31_t)(history[1] >> 32);
+				state[stage][2] = history[0];
+				state[stage][3] = history[1];
+			}
+			history[0] = state[stage][2];
+			history[1] = state[stage][3];
+			stage++;
+		}
+		if (previous_mask & notch_bit)
+		{
+			previous_stage++;
+		}
+	}
+
+	filter->q31_cascade[axis].numStages = stage;
+	filter->applied_mask[axis] = active_mask;
+}
+#endif
+
+static void RPM_notch_coefficients_compute(RPM_notch_coefficients_t *coefficients, float omega, float quality_factor)
+{
+#if defined(USE_RPM_FILTER_SVF)
+	// g = tan(omega / 2) = sin(omega) / (1 + cos(omega)):
+#if defined(USE_FAST_TRIGONOMETRY)
+	float sn;
+	float cs;
+	fast_sin_cos(omega, &sn, &cs);
+	const float g = sn / (1 + cs);
+#else
+	const float g = tanf(0.5f * omega);
+#endif
+	coefficients->k = 1.f / quality_factor;
+	coefficients->a1 = 1.f / (1 + g * (g + coefficients->k));
+	coefficients->a2 = g * coefficients->a1;
+	coefficients->a3 = g * coefficients->a2;
+#else
+	biquad_coefficients_compute(coefficients, BIQUAD_NOTCH, omega, quality_factor);
+#endif
+}
+
+static FORCE_INLINE float RPM_notch_apply(const RPM_notch_coefficients_t *coefficients, float weight, uint8_t active_notch, float state[4], bool primed, float input)
+{
+	if (!primed)
+	{
+		// notch was skipped so its state is old - start from steady state for current input (notch gain is 1 away from its frequency):
+#if defined(USE_RPM_FILTER_SVF)
+		state[0] = 0;	  // band-pass integrator
+		state[1] = input; // low-pass integrator
+#else
+		state[0] = input;
+		state[1] = input;
+		state[2] = input;
+		state[3] = input;
+#endif
+	}
+
+#if defined(USE_RPM_FILTER_SVF)
+	const float output = svf_notch_step(coefficients, state, input);
+#else
+	const float output = biquad_DF1_step(coefficients, state, input);
+#endif
+
+	// only fading notches have to be blended:
+	if (active_notch & RPM_NOTCH_FADING)
+	{
+		return weight * output + (1 - weight) * input;
+	}
+	return output;
+}
+
+RAMFUNC float RPM_filter_apply(RPM_filter_t *filter, uint8_t axis, float input)
+{
+	float result = input;
+
+#if defined(USE_RPM_FILTER_CMSIS)
+	// active notches of the axis in one library call (weights are already in coefficients):
+	arm_biquad_casd_df1_inst_f32 *cascade = RPM_filter_cascade(filter, RPM_filter_apply_bank(filter), axis, input);
+	// library loops run at least one stage:
+	if (cascade->numStages > 0)
+	{
+		arm_biquad_cascade_df1_f32(cascade, &input, &result, 1);
+	}
+#elif defined(USE_RPM_FILTER_Q31)
+	// fixed-point cascade of active notches:
+	result = RPM_filter_from_q31(RPM_filter_apply_q31(filter, axis, RPM_filter_to_q31(input)));
+#elif defined(USE_RPM_FILTER_UNROLLED)
+	// every notch has its own code with constant offsets (inactive ones are skipped by a branch):
+	const RPM_filter_bank_t *bank = RPM_filter_apply_bank(filter);
+	uint32_t applied_mask = 0;
+#define RPM_UNROLLED_NOTCH(motor, harmonic) RPM_unrolled_notch(filter, bank, motor, harmonic, axis, &result, &applied_mask);
+	RPM_FOR_EACH_NOTCH(RPM_UNROLLED_NOTCH)
+#undef RPM_UNROLLED_NOTCH
+	filter->applied_mask[axis] = applied_mask;
+#else
+	// notches are indexed as motor * RPM_MAX_HARMONICS + harmonic:
+	const RPM_filter_bank_t *bank = RPM_filter_apply_bank(filter);
+	const RPM_notch_coefficients_t *coefficients = bank->coefficients[0];
+	const float *weight = bank->weight[0];
+	float(*state)[4] = filter->state[axis][0];
+	const uint32_t primed_mask = filter->applied_mask[axis];
+	uint32_t applied_mask = 0;
+
+	for (uint8_t i = 0; i < bank->active_count; i++)
+	{
+		const uint8_t active_notch = bank->active_notches[i];
+		const uint8_t notch = active_notch & RPM_NOTCH_INDEX;
+
+		result = RPM_notch_apply(&coefficients[notch], weight[notch], active_notch, state[notch], primed_mask & (1UL << notch), result);
+		applied_mask |= 1UL << notch;
+	}
+
+	filter->applied_mask[axis] = applied_mask;
+#endif
 
 	return result;
 }
+
+RAMFUNC void RPM_filter_apply_block(RPM_filter_t *filter, uint8_t axis, float samples[], uint16_t block_size)
+{
+	if (block_size == 0)
+	{
+		return;
+	}
+
+#if defined(USE_RPM_FILTER_CMSIS)
+	// library keeps coefficients and state of each notch in registers for the whole block:
+	arm_biquad_casd_df1_inst_f32 *cascade = RPM_filter_cascade(filter, RPM_filter_apply_bank(filter), axis, samples[0]);
+	if (cascade->numStages > 0)
+	{
+		arm_biquad_cascade_df1_f32(cascade, samples, samples, block_size);
+	}
+#elif defined(USE_RPM_FILTER_Q31)
+	q31_t block[RPM_FILTER_Q31_BLOCK];
+	for (uint16_t start = 0; start < block_size; start += RPM_FILTER_Q31_BLOCK)
+	{
+		const uint16_t length = block_size - start < RPM_FILTER_Q31_BLOCK ? block_size - start : RPM_FILTER_Q31_BLOCK;
+		for (uint16_t i = 0; i < length; i++)
+		{
+			block[i] = RPM_filter_to_q31(samples[start + i]);
+		}
+		RPM_filter_apply_block_q31(filter, axis, block, length);
+		for (uint16_t i = 0; i < length; i++)
+		{
+			samples[start + i] = RPM_filter_from_q31(block[i]);
+		}
+	}
+#else
+	// notch after notch - each one goes through the whole block with coefficients and state in local variables (registers):
+	const RPM_filter_bank_t *bank = RPM_filter_apply_bank(filter);
+	const RPM_notch_coefficients_t *coefficients = bank->coefficients[0];
+	const float *weights = bank->weight[0];
+	float(*state)[4] = filter->state[axis][0];
+	const uint32_t primed_mask = filter->applied_mask[axis];
+	uint32_t applied_mask = 0;
+
+	for (uint8_t i = 0; i < bank->active_count; i++)
+	{
+		const uint8_t active_notch = bank->active_notches[i];
+		const uint8_t notch = active_notch & RPM_NOTCH_INDEX;
+		const RPM_notch_coefficients_t coefficient = coefficients[notch];
+		const float weight = weights[notch];
+		float notch_state[4] = {state[notch][0], state[notch][1], state[notch][2], state[notch][3]};
+
+		samples[0] = RPM_notch_apply(&coefficient, weight, active_notch, notch_state, primed_mask & (1UL << notch), samples[0]);
+		for (uint16_t n = 1; n < block_size; n++)
+		{
+			samples[n] = RPM_notch_apply(&coefficient, weight, active_notch, notch_state, true, samples[n]);
+		}
+
+		for (uint8_t k = 0; k < 4; k++)
+		{
+			state[notch][k] = notch_state[k];
+		}
+		applied_mask |= 1UL << notch;
+	}
+
+	filter->applied_mask[axis] = applied_mask;
+#endif
+}
+
+#if defined(USE_RPM_FILTER_Q31)
+RAMFUNC q31_t RPM_filter_apply_q31(RPM_filter_t *filter, uint8_t axis, q31_t input)
+{
+	// integer cascade only - the same notches as RPM_filter_apply() without conversions:
+	q31_t result = input;
+	arm_biquad_cas_df1_32x64_ins_q31 *cascade = RPM_filter_cascade(filter, RPM_filter_apply_bank(filter), axis, input);
+	if (cascade->numStages > 0)
+	{
+		arm_biquad_cas_df1_32x64_q31(cascade, &input, &result, 1);
+	}
+	return result;
+}
+
+RAMFUNC void RPM_filter_apply_block_q31(RPM_filter_t *filter, uint8_t axis, q31_t samples[], uint16_t block_size)
+{
+	if (block_size == 0)
+	{
+		return;
+	}
+
+	arm_biquad_cas_df1_32x64_ins_q31 *cascade = RPM_filter_cascade(filter, RPM_filter_apply_bank(filter), axis, samples[0]);
+	if (cascade->numStages > 0)
+	{
+		arm_biquad_cas_df1_32x64_q31(cascade, samples, samples, block_size);
+	}
+}
+#endif
+
+RAMFUNC void RPM_filter_apply3(RPM_filter_t *filter, float xyz[3])
+{
+#if defined(USE_RPM_FILTER_CMSIS)
+	// library cascade works on one axis at a time:
+	const RPM_filter_bank_t *bank = RPM_filter_apply_bank(filter);
+	for (uint8_t axis = 0; axis < 3; axis++)
+	{
+		float input = xyz[axis];
+		arm_biquad_casd_df1_inst_f32 *cascade = RPM_filter_cascade(filter, bank, axis, input);
+		if (cascade->numStages > 0)
+		{
+			arm_biquad_cascade_df1_f32(cascade, &input, &xyz[axis], 1);
+		}
+	}
+#elif defined(USE_RPM_FILTER_Q31)
+	for (uint8_t axis = 0; axis < 3; axis++)
+	{
+		xyz[axis] = RPM_filter_apply(filter, axis, xyz[axis]);
+	}
+#elif defined(USE_RPM_FILTER_UNROLLED)
+	float x = xyz[0];
+	float y = xyz[1];
+	float z = xyz[2];
+	const RPM_filter_bank_t *bank = RPM_filter_apply_bank(filter);
+	uint32_t applied_mask = 0;
+#define RPM_UNROLLED_NOTCH3(motor, harmonic) RPM_unrolled_notch3(filter, bank, motor, harmonic, &x, &y, &z, &applied_mask);
+	RPM_FOR_EACH_NOTCH(RPM_UNROLLED_NOTCH3)
+#undef RPM_UNROLLED_NOTCH3
+	filter->applied_mask[0] = applied_mask;
+	filter->applied_mask[1] = applied_mask;
+	filter->applied_mask[2] = applied_mask;
+
+	xyz[0] = x;
+	xyz[1] = y;
+	xyz[2] = z;
+#else
+	// each notch is loaded once and used for all axes - 3 independent chains keep FPU pipeline busy.
+	// Local copies let compiler keep them in registers (state stores could alias filter and xyz otherwise):
+	float x = xyz[0];
+	float y = xyz[1];
+	float z = xyz[2];
+
+	const RPM_filter_bank_t *bank = RPM_filter_apply_bank(filter);
+	const RPM_notch_coefficients_t *coefficients = bank->coefficients[0];
+	const float *weights = bank->weight[0];
+	float(*state_x)[4] = filter->state[0][0];
+	float(*state_y)[4] = filter->state[1][0];
+	float(*state_z)[4] = filter->state[2][0];
+	const uint32_t primed_mask_x = filter->applied_mask[0];
+	const uint32_t primed_mask_y = filter->applied_mask[1];
+	const uint32_t primed_mask_z = filter->applied_mask[2];
+	uint32_t applied_mask = 0;
+
+	for (uint8_t i = 0; i < bank->active_count; i++)
+	{
+		const uint8_t active_notch = bank->active_notches[i];
+		const uint8_t notch = active_notch & RPM_NOTCH_INDEX;
+		const uint32_t notch_bit = 1UL << notch;
+		const RPM_notch_coefficients_t coefficient = coefficients[notch];
+		const float weight = weights[notch];
+
+		x = RPM_notch_apply(&coefficient, weight, active_notch, state_x[notch], primed_mask_x & notch_bit, x);
+		y = RPM_notch_apply(&coefficient, weight, active_notch, state_y[notch], primed_mask_y & notch_bit, y);
+		z = RPM_notch_apply(&coefficient, weight, active_notch, state_z[notch], primed_mask_z & notch_bit, z);
+		applied_mask |= notch_bit;
+	}
+
+	filter->applied_mask[0] = applied_mask;
+	filter->applied_mask[1] = applied_mask;
+	filter->applied_mask[2] = applied_mask;
+
+	xyz[0] = x;
+	xyz[1] = y;
+	xyz[2] = z;
+#endif
+}
+
+#if defined(USE_RPM_FILTER_UNROLLED)
+static FORCE_INLINE void RPM_unrolled_notch(RPM_filter_t *filter, const RPM_filter_bank_t *bank, uint8_t motor, uint8_t harmonic, uint8_t axis, float *value, uint32_t *applied_mask)
+{
+	// motor and harmonic are constants so after inlining all offsets are known at compile time (the same notches as in active_notches):
+	const uint8_t notch = motor * RPM_MAX_HARMONICS + harmonic;
+	const float weight = bank->weight[motor][harmonic];
+	if (weight <= 0)
+	{
+		return;
+	}
+	const uint8_t active_notch = weight < 1 ? notch | RPM_NOTCH_FADING : notch;
+	const uint32_t notch_bit = 1UL << notch;
+
+	*value = RPM_notch_apply(&(bank->coefficients[motor][harmonic]), weight, active_notch, filter->state[axis][motor][harmonic], filter->applied_mask[axis] & notch_bit, *value);
+	*applied_mask |= notch_bit;
+}
+
+static FORCE_INLINE void RPM_unrolled_notch3(RPM_filter_t *filter, const RPM_filter_bank_t *bank, uint8_t motor, uint8_t harmonic, float *x, float *y, float *z, uint32_t *applied_mask)
+{
+	const uint8_t notch = motor * RPM_MAX_HARMONICS + harmonic;
+	const float weight = bank->weight[motor][harmonic];
+	if (weight <= 0)
+	{
+		return;
+	}
+	const uint8_t active_notch = weight < 1 ? notch | RPM_NOTCH_FADING : notch;
+	const uint32_t notch_bit = 1UL << notch;
+	const RPM_notch_coefficients_t coefficient = bank->coefficients[motor][harmonic];
+
+	*x = RPM_notch_apply(&coefficient, weight, active_notch, filter->state[0][motor][harmonic], filter->applied_mask[0] & notch_bit, *x);
+	*y = RPM_notch_apply(&coefficient, weight, active_notch, filter->state[1][motor][harmonic], filter->applied_mask[1] & notch_bit, *y);
+	*z = RPM_notch_apply(&coefficient, weight, active_notch, filter->state[2][motor][harmonic], filter->applied_mask[2] & notch_bit, *z);
+	*applied_mask |= notch_bit;
+}
+#endif
@@ -9,7 +9,21 @@
 #define FILTERS_H_
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "global_constants.h"
+#if defined(USE_RPM_FILTER_CMSIS) && defined(USE_RPM_FILTER_Q31)
+#error "choose one RPM filter backend: USE_RPM_FILTER_CMSIS or USE_RPM_FILTER_Q31"
+#endif
+#if defined(USE_RPM_FILTER_SVF) && (defined(USE_RPM_FILTER_CMSIS) || defined(USE_RPM_FILTER_Q31))
+#error "USE_RPM_FILTER_SVF works only with float RPM filter backend"
+#endif
+#if defined(USE_RPM_FILTER_UNROLLED) && (defined(USE_RPM_FILTER_CMSIS) || defined(USE_RPM_FILTER_Q31))
+#error "USE_RPM_FILTER_UNROLLED works only with float RPM filter backend"
+#endif
+#if defined(USE_RPM_FILTER_CMSIS) || defined(USE_RPM_FILTER_Q31)
+#define RPM_FILTER_CASCADE // notches are run by CMSIS-DSP cascade with weights folded into coefficients
+#include "arm_math.h"
+#endif
 
 // "Notch filter is just a combination of low and high pass filter" - not really! This description is good for band-stop filter
 // Notch filter is much more precise and narrower. It is a combination of:
@@ -37,6 +51,23 @@ typedef struct
 	float y2; //	2nd last output
 } biquad_Filter_t;
 
+// normalized coefficients (a0 = 1) - they can be shared by filters with separated state:
+typedef struct
+{
+	float b0;
+	float b1;
+	float b2;
+	float a1;
+	float a2;
+} biquad_coefficients_t;
+
+// 1st order low-pass filter:
+typedef struct
+{
+	float k;	  // dt / (RC + dt)
+	float output; // last output
+} PT1_Filter_t;
+
 typedef enum
 {
 	BIQUAD_LPF,
@@ -44,21 +75,142 @@ typedef enum
 	BIQUAD_BPF,
 } biquad_Filter_type;
 
+// notch as state variable filter (Andrew Simper, Cytomic) with trapezoidal integrators.
+// Its state is kept in integrators (not in past samples), so it stays valid when coefficients change:
+typedef struct
+{
+	float k;  // 1 / Q
+	float a1; // 1 / (1 + g * (g + k)), where g = tan(PI * f / fs)
+	float a2; // g * a1
+	float a3; // g * a2
+} svf_coefficients_t;
+
+#if defined(USE_RPM_FILTER_SVF)
+typedef svf_coefficients_t RPM_notch_coefficients_t; // notch state is {ic1eq, ic2eq, -, -}
+#else
+typedef biquad_coefficients_t RPM_notch_coefficients_t; // notch state is {x1, x2, y1, y2}
+#endif
+
+// alpha-beta tracker of motor frequency (USE_RPM_ESTIMATOR):
 typedef struct
 {
-	biquad_Filter_t notch_filters[3][MOTORS_COUNT][RPM_MAX_HARMONICS]; // each axes (X,Y,Z) for each motor and its harmonics
-	float weight[3][MOTORS_COUNT][RPM_MAX_HARMONICS];				   // weight used to fade out filter (0 - filter is off, 1 - is used in 100%)
-	float q_factor;													   // q_factor for all notches
-	uint8_t harmonics;												   // number of filtered harmonics
+	float frequency;		   // estimated motor frequency at measurement_time [Hz]
+	float rate;				   // its change rate [Hz/s]
+	uint32_t measurement_time; // time of the last telemetry used (DWT->CYCCNT)
+} RPM_estimator_t;
+
+#define RPM_NOTCH_FADING 0x80 // flag in RPM_filter_t active_notches - notch has to be blended with its input
+#define RPM_NOTCH_INDEX 0x7F  // notch index in RPM_filter_t active_notches
+
+#if MOTORS_COUNT * RPM_MAX_HARMONICS > 32
+#error "RPM filter notches are tracked with 32-bit masks - reduce RPM_MAX_HARMONICS"
+#endif
+
+#if defined(USE_RPM_FILTER_DOUBLE_BUFFER)
+#define RPM_FILTER_BANKS 2
+#else
+#define RPM_FILTER_BANKS 1
+#endif
+
+// everything apply functions read from RPM filter (state excluded). With USE_RPM_FILTER_DOUBLE_BUFFER one bank is read by apply
+// while the other one is changed by RPM_filter_update() (and setters) and then they are swapped:
+typedef struct
+{
+	RPM_notch_coefficients_t coefficients[MOTORS_COUNT][RPM_MAX_HARMONICS]; // notch for each motor and its harmonics (the same for each axis)
+	float weight[MOTORS_COUNT][RPM_MAX_HARMONICS];						 // weight used to fade out filter (0 - filter is off, 1 - is used in 100%)
+	uint8_t active_notches[MOTORS_COUNT * RPM_MAX_HARMONICS];			 // notches with weight > 0 (motor * RPM_MAX_HARMONICS + harmonic), RPM_NOTCH_FADING if weight < 1
+	uint8_t active_count;												 // number of active notches
+#if defined(RPM_FILTER_CASCADE)
+	uint32_t active_mask; // active notches as a mask - cascade stages are active notches in natural order
+#endif
+#if defined(USE_RPM_FILTER_CMSIS)
+	// {b0, b1, b2, -a1, -a2} for each active notch (cascade stage, the same for all axes) with weight folded in: b' = w * b + (1 - w) * a
+	float cmsis_coefficients[5 * MOTORS_COUNT * RPM_MAX_HARMONICS];
+#endif
+#if defined(USE_RPM_FILTER_Q31)
+	// the same as cmsis_coefficients but in Q1.30 (notch coefficients are in -2...2 range so cascade uses postShift = 1):
+	q31_t q31_coefficients[5 * MOTORS_COUNT * RPM_MAX_HARMONICS];
+#endif
+} RPM_filter_bank_t;
+
+typedef struct
+{
+	RPM_filter_bank_t banks[RPM_FILTER_BANKS];							 // notches (coefficients, weights and active ones)
+	volatile uint8_t bank_index;										 // bank read by apply functions (the other one is changed by RPM_filter_update())
+	float state[3][MOTORS_COUNT][RPM_MAX_HARMONICS][4];					 // state of each notch for each axes (X,Y,Z) - see RPM_notch_coefficients_t (CMSIS: of each cascade stage)
+	float tuned_frequency[MOTORS_COUNT][RPM_MAX_HARMONICS];				 // center frequency of current coefficients [Hz]
+	uint32_t retunes_done;												 // notches recomputed by RPM_filter_update()
+	uint32_t retunes_skipped;											 // notches left as they were (frequency change below RPM_RETUNE_THRESHOLD)
+	uint8_t retune_skips[MOTORS_COUNT][RPM_MAX_HARMONICS];				 // updates skipped since the notch was tuned (retuned after RPM_RETUNE_MAX_SKIPS)
+#if defined(USE_RPM_ESTIMATOR)
+	RPM_estimator_t estimators[MOTORS_COUNT];							 // motors' frequencies between and within telemetry frames
+#endif
+	uint8_t update_motor;												 // motor updated by the next RPM_filter_update() call (USE_RPM_UPDATE_ROUND_ROBIN)
+	uint32_t applied_mask[3];											 // notches applied to each axis by the last apply (re-entering notches have their state primed, cascade stages are moved)
+	float q_factor[RPM_MAX_HARMONICS];									 // q_factor of notches for each harmonic
+	uint8_t harmonics;													 // number of filtered harmonics (runtime limit <= RPM_MAX_HARMONICS)
+	uint8_t harmonics_mask;												 // filtered harmonics (bit 0 - fundamental) within harmonics count
+	uint8_t active_harmonics[RPM_MAX_HARMONICS];						 // harmonics from harmonics_mask (loops run only over them)
+	uint8_t active_harmonics_count;										 // number of harmonics in active_harmonics
+	uint16_t sampling_frequency_Hz;										 // fs of filtered samples (RPM_filter_set_sampling_frequency())
+	float sampling_period_s;											 // 1 / fs
+	float omega_per_Hz;													 // 2 * PI / fs - normalized angular frequency of 1 [Hz]
+	float max_frequency_Hz;												 // notches above it are off (almost Nyquist frequency)
+	float min_frequency_Hz;												 // notches below it are off
+	float fade_frequency_Hz;											 // notches below it are faded out
+	float fade_range_inverse;											 // 1 / (fade_frequency_Hz - min_frequency_Hz)
+#if defined(USE_RPM_FILTER_CMSIS)
+	arm_biquad_casd_df1_inst_f32 cmsis_cascade[3]; // one cascade for each axis (uses state)
+#endif
+#if defined(USE_RPM_FILTER_Q31)
+	q63_t q31_state[3][4 * MOTORS_COUNT * RPM_MAX_HARMONICS]; // {x1, x2, y1, y2} for each cascade stage of each axis
+	arm_biquad_cas_df1_32x64_ins_q31 q31_cascade[3];		  // one cascade for each axis
+#endif
 
 } RPM_filter_t;
 
 void biquad_filter_init(biquad_Filter_t *filter, biquad_Filter_type filter_type, float center_frequency_Hz, float quality_factor, uint16_t sampling_frequency_Hz);
-float biquad_filter_apply_DF1(biquad_Filter_t *filter, float input);
+void biquad_filter_update(biquad_Filter_t *filter, biquad_Filter_type filter_type, float center_frequency_Hz, float quality_factor, uint16_t sampling_frequency_Hz); // new coefficients, state is kept
 float biquad_filter_apply_DF2(biquad_Filter_t *filter, float input);
 
+void PT1_filter_init(PT1_Filter_t *filter, float cutoff_frequency_Hz, uint16_t sampling_frequency_Hz);
+
+// per-sample helpers are inlined into their callers (RAM-resident filter loops with USE_RAMFUNC):
+static FORCE_INLINE float biquad_filter_apply_DF1(biquad_Filter_t *filter, float input)
+{
+	// compute result:
+	const float result = filter->b0 * input + filter->b1 * filter->x1 + filter->b2 * filter->x2 - filter->a1 * filter->y1 - filter->a2 * filter->y2;
+
+	// shift x1 to x2, input to x1:
+	filter->x2 = filter->x1;
+	filter->x1 = input;
+
+	// shift y1 to y2, result to y1:
+	filter->y2 = filter->y1;
+	filter->y1 = result;
+
+	return result;
+}
+
+static FORCE_INLINE float PT1_filter_apply(PT1_Filter_t *filter, float input)
+{
+	filter->output += filter->k * (input - filter->output);
+
+	return filter->output;
+}
+
 void RPM_filter_init(RPM_filter_t *filter, uint16_t sampling_frequency_Hz);
-float RPM_filter_apply(RPM_filter_t *filter, uint8_t axis, float input);
+RAMFUNC float RPM_filter_apply(RPM_filter_t *filter, uint8_t axis, float input);
+RAMFUNC void RPM_filter_apply3(RPM_filter_t *filter, float xyz[3]); // filters all axes at once (in place)
+RAMFUNC void RPM_filter_apply_block(RPM_filter_t *filter, uint8_t axis, float samples[], uint16_t block_size); // filters a burst of one axis samples (in place), e.g. IMU FIFO
+#if defined(USE_RPM_FILTER_Q31)
+// fixed-point entry points - gyro in Q31 with RPM_FILTER_Q31_RANGE full scale. No FPU instruction is used, so an ISR calling them has no FPU context to stack:
+RAMFUNC q31_t RPM_filter_apply_q31(RPM_filter_t *filter, uint8_t axis, q31_t input);
+RAMFUNC void RPM_filter_apply_block_q31(RPM_filter_t *filter, uint8_t axis, q31_t samples[], uint16_t block_size); // in place
+#endif
 void RPM_filter_update(RPM_filter_t *filter);
+void RPM_filter_set_harmonics(RPM_filter_t *filter, uint8_t harmonics, uint8_t harmonics_mask);
+void RPM_filter_set_q_factor(RPM_filter_t *filter, uint8_t harmonic, float q_factor);
+void RPM_filter_set_sampling_frequency(RPM_filter_t *filter, uint16_t sampling_frequency_Hz); // e.g. loop rate change - all notches are retuned at once
 
 #endif /* FILTERS_H_ */
@@ -9,6 +9,40 @@
 #define GLOBAL_CONSTANTS_H_
 #include <stdbool.h>
 
+//-------------------SYSTEM-------------------
+#define SYSTEM_CLOCK_MHZ 168 // core clock set in setup_PLL() [MHz]
+
+//-------------------MEMORY-------------------
+#define USE_CCMRAM    // hot filter and control-loop state in CCM RAM (only CPU has access to it - never put DMA buffers there)
+#define USE_DMA_SRAM2 // DMA buffers in SRAM2 (CPU works on SRAM1 so DMA and CPU don't compete for the same memory)
+
+#if defined(USE_CCMRAM)
+#define CCMRAM __attribute__((section(".ccmram_bss"))) // zero-initialized variable in CCM RAM
+#else
+#define CCMRAM
+#endif
+
+#if defined(USE_DMA_SRAM2)
+#define DMA_RAM __attribute__((section(".sram2_bss"))) // zero-initialized DMA buffer in SRAM2
+#else
+#define DMA_RAM
+#endif
+
+// Code executed from flash has to wait for it (5 wait states at 168 [MHz]) unless ART accelerator (prefetch and caches) has it ready.
+// Functions in SRAM (copied there by the startup code together with .data) are executed without wait states and their timing doesn't depend on the cache state:
+#define USE_FLASH_ART // enable ART accelerator (prefetch, instruction and data caches)
+#define USE_RAMFUNC   // execute hot ISRs and filters from SRAM
+
+#if defined(USE_RAMFUNC) && defined(__arm__)
+#define RAMFUNC __attribute__((section(".ramfunc"), noinline, long_call)) // use it for declaration and definition
+#elif defined(USE_RAMFUNC)
+#define RAMFUNC __attribute__((section(".ramfunc"), noinline)) // host build (tests) - there are no long calls
+#else
+#define RAMFUNC
+#endif
+// per-sample helpers of RAMFUNC loops - inlined even without optimization (out-of-line copy would be called in flash):
+#define FORCE_INLINE inline __attribute__((always_inline))
+
 //------------ESC_PROTOCOLS----------
 #define BIT_BANGING_V1
 #define DSHOT_MODE 300 // 150 300 600 1200
@@ -37,6 +71,31 @@
 #define BDSHOT_RESPONSE_BITRATE (DSHOT_MODE * 4 / 3) // in my tests this value was not 5/4 * DSHOT_MODE as documentation suggests
 #define BDSHOT_RESPONSE_OVERSAMPLING 3               // it has to be a factor of (DSHOT_BB_FRAME_LENGTH * DSHOT_MODE / BDSHOT_RESPONSE_BITRATE)
 
+// BDSHOT response is being sampled just after transmission. There is ~33 [us] break before response (additional sampling).
+// Length is rounded up to 4 samples so that reception can use DMA bursts:
+#define BDSHOT_RESPONSE_BUFFER_LENGTH (((33 * BDSHOT_RESPONSE_BITRATE / 1000 + BDSHOT_RESPONSE_LENGTH + 1) * BDSHOT_RESPONSE_OVERSAMPLING + 3) / 4 * 4)
+
+// BDshot watchdog - whole frame (transmission + ~33 [us] gap + response) has to be completed in this time:
+#define BDSHOT_TX_TIME_US (DSHOT_BB_BUFFER_LENGTH * 1000 / DSHOT_MODE)                                                   // transmission time [us]
+#define BDSHOT_RX_TIME_US (BDSHOT_RESPONSE_BUFFER_LENGTH * 1000 / BDSHOT_RESPONSE_BITRATE / BDSHOT_RESPONSE_OVERSAMPLING) // reception time [us]
+#define BDSHOT_WATCHDOG_MARGIN_US 20                                                                                    // time for ISRs and decoding [us]
+#define BDSHOT_FRAME_BUDGET_US (BDSHOT_TX_TIME_US + BDSHOT_RX_TIME_US + BDSHOT_WATCHDOG_MARGIN_US)                      // [us]
+
+// #define USE_BDSHOT_PROBES // DWT cycle counter probes of BDshot pipeline stages (results in bdshot_probes, compiled out when not defined)
+
+// BDshot scheduler - TIM7 sends frames at fixed rate with the latest values published by update_motors()/BDshot_publish():
+// #define USE_BDSHOT_SCHEDULER
+#define BDSHOT_OUTPUT_RATE_HZ 1000 // 1000 - 8000 [Hz] (whole frame has to fit in one period - use higher DSHOT_MODE for high rates)
+
+// DMA mode of bit-banging streams (BDSHOT_DMA_DIRECT, BDSHOT_DMA_FIFO, BDSHOT_DMA_FIFO_BURST) - can be changed with BDshot_set_DMA_mode():
+#define BDSHOT_DMA_TX_MODE BDSHOT_DMA_DIRECT
+#define BDSHOT_DMA_RX_MODE BDSHOT_DMA_DIRECT
+#define BDSHOT_DMA_FIFO_THRESHOLD 1 // FIFO threshold for BDSHOT_DMA_FIFO mode (0 - 1/4; 1 - 1/2; 2 - 3/4; 3 - full)
+
+#if defined(USE_BDSHOT_SCHEDULER) && (1000000 / BDSHOT_OUTPUT_RATE_HZ < BDSHOT_FRAME_BUDGET_US)
+#error "BDshot frame doesn't fit in one scheduler period - decrease BDSHOT_OUTPUT_RATE_HZ or increase DSHOT_MODE"
+#endif
+
 //-------------------MOTORS--------------------
 #define MOTORS_COUNT 4        // how many motors are used
 #define MOTOR_1 3             // PA3
@@ -47,11 +106,12 @@
 
 //-------------------FILTERS------------------
 #define FREQUENCY_OF_SAMPLING_HZ 900                                 // frequency of sampling data [Hz]
-#define MAX_FREQUENCY_FOR_FILTERING 0.48f * FREQUENCY_OF_SAMPLING_HZ // maximal frequency that can be filtered (almost Nyquist frequency) [Hz]
+#define MAX_FREQUENCY_FOR_FILTERING_RATIO 0.48f                     // part of sampling frequency that can be filtered (almost Nyquist frequency)
 
 #define BIQUAD_LPF_CUTOFF 50        //	[Hz]
 #define BIQUAD_LPF_Q 1.f / sqrtf(2) //	Q factor for Low-pass filters
 #define BIQUAD_NOTCH_Q 100          //	Q factor for notch filters (bigger value -> narrower notch)
+#define FILTER_PIPELINE_MAX_STAGES 6 // max. number of stages in filter_pipeline_t
 
 // RPM filter:
 #define USE_RPM_FILTER // if you want use RPM_filter USE_RPM_FILTER
@@ -60,5 +120,39 @@
 #define RPM_FADE_RANGE_HZ 50    // fade out notch when approaching RPM_MIN_FREQUENCY_HZ (turn it off for RPM_MIN_FREQUENCY_HZ)
 #define RPM_Q_FACTOR 500        // Q factor for all notches. It is VERY HIGH therefore notches are really narrow and selective
 #define RPM_MAX_HARMONICS 3     // max. number of filtered harmonics
+#define RPM_HARMONICS_MASK 0x07 // filtered harmonics (bit 0 - fundamental, bit 1 - 2nd harmonic...), e.g. 0x05 for tri-blade props, can be changed with RPM_filter_set_harmonics()
+// #define USE_RPM_UPDATE_ROUND_ROBIN // RPM_filter_update() recomputes notches of one motor per call (for high loop rates), each notch is at most MOTORS_COUNT calls old
+// #define USE_RPM_ESTIMATOR      // motors' frequencies are smoothed (alpha-beta tracker) and predicted for RPM_filter_update() time
+#define RPM_ESTIMATOR_ALPHA 0.5f  // part of telemetry residual added to estimated frequency (0-1, lower - smoother)
+#define RPM_ESTIMATOR_BETA 0.05f  // part of telemetry residual added to estimated frequency change rate (0-ALPHA)
+#define RPM_ESTIMATOR_MAX_PREDICTION_US 3000 // frequency is not extrapolated further than this from the last telemetry [us]
+// #define USE_RPM_ALIAS_FOLDING  // harmonics above MAX_FREQUENCY_FOR_FILTERING_RATIO * sampling frequency are notched at their aliased frequency (instead of being turned off)
+// Detuned notch leaves ~2 * THRESHOLD of the tone at its old center (0.1 - -14 [dB], 0.01 - -34 [dB]), lower values cost more coefficient computations.
+// Small steady detune (e.g. hover) is removed anyway after RPM_RETUNE_MAX_SKIPS skipped updates - full depth (-80 [dB] and more) is restored.
+#define RPM_RETUNE_THRESHOLD 0.01f // notch is retuned at once if its frequency moved by more than this fraction of its bandwidth (f/Q), 0 - on every change
+#define RPM_RETUNE_MAX_SKIPS 8     // notch with any frequency change is retuned after this many skipped updates (1-255)
+// #define USE_RPM_FILTER_CMSIS    // notches of each axis are run as CMSIS-DSP biquad cascade (weights folded into coefficients)
+// #define USE_RPM_FILTER_Q31      // notches of each axis are run as CMSIS-DSP Q31 cascade with 64-bit state (fixed-point, no FPU with RPM_filter_apply_q31())
+// #define USE_RPM_FILTER_SVF      // notches are run as state variable filters (Simper) - no transients when notches are retuned every loop (float only)
+// #define USE_RPM_FILTER_DOUBLE_BUFFER // notches are prepared in the second bank and swapped atomically - apply (e.g. gyro ISR at 4-8 [kHz]) doesn't wait for RPM_filter_update() (telemetry rate)
+// #define USE_RPM_FILTER_UNROLLED // float notches are applied by straight-line code generated for MOTORS_COUNT x RPM_MAX_HARMONICS (instead of loop over active notches)
+#define RPM_FILTER_Q31_RANGE 4096.f // full scale of RPM filter input/output in Q31 mode (gyro [deg/s])
+#define RPM_FILTER_Q31_BLOCK 32     // samples converted at once by RPM_filter_apply_block() in Q31 mode (longer blocks are split)
+#define USE_FAST_TRIGONOMETRY   // biquad coefficients with polynomial sin/cos instead of libm sinf/cosf (see filters.c for accuracy)
+
+// Dynamic notch (non-motor noise found with FFT):
+// #define USE_DYNAMIC_NOTCH
+#define DYNAMIC_NOTCH_FFT_LENGTH 128       // samples in FFT window (power of 2, 32-2048) - resolution is FREQUENCY_OF_SAMPLING_HZ / DYNAMIC_NOTCH_FFT_LENGTH
+#define DYNAMIC_NOTCH_BINS_PER_UPDATE 16   // bins processed by one dynamic_notch_update() call (bounds its CPU time)
+#define DYNAMIC_NOTCH_COUNT 2              // notches for each axis (the strongest peaks are followed)
+#define DYNAMIC_NOTCH_Q 5                  // Q factor of dynamic notches (noise peaks are wide)
+#define DYNAMIC_NOTCH_MIN_HZ 80            // peaks are searched in DYNAMIC_NOTCH_MIN_HZ ... DYNAMIC_NOTCH_MAX_HZ [Hz]
+#define DYNAMIC_NOTCH_MAX_HZ 400           // (notches are kept in this range too)
+#define DYNAMIC_NOTCH_SMOOTHING 0.5f       // notch moves by this part of the distance to the new peak after each window (0-1)
+
+
+//-------------------BENCHMARKS------------------
+// #define USE_BENCHMARKS // run on-target benchmarks once after setup (results are in benchmark_results - watch them with debugger)
+#define BENCHMARK_RUNS 100 // how many times each measurement is repeated
 
 #endif /*GLOBAL_CONSTANTS_H_*/
\ No newline at end of file
@@ -10,10 +10,12 @@
 #include "global_variables.h"
 
 //	motor's RPM values (from BDshot)
-uint32_t motors_rpm[MOTORS_COUNT];
+uint32_t motors_rpm[MOTORS_COUNT] CCMRAM;
+//	time of the last correct motor's RPM value (DWT->CYCCNT)
+uint32_t motors_rpm_time[MOTORS_COUNT] CCMRAM;
 
 // used in BDshot:
-float motors_error[MOTORS_COUNT];
+float motors_error[MOTORS_COUNT] CCMRAM;
 
 // pointers for motor's values:
 uint16_t *motor_1_value_pointer;
@@ -21,8 +23,9 @@ uint16_t *motor_2_value_pointer;
 uint16_t *motor_3_value_pointer;
 uint16_t *motor_4_value_pointer;
 
-uint32_t dshot_bb_buffer_1_4[DSHOT_BB_BUFFER_LENGTH * DSHOT_BB_FRAME_SECTIONS];
-uint32_t dshot_bb_buffer_2_3[DSHOT_BB_BUFFER_LENGTH * DSHOT_BB_FRAME_SECTIONS];
+// buffers are aligned so that DMA bursts never cross 1 KB boundary:
+uint32_t dshot_bb_buffer_1_4[DSHOT_BB_BUFFER_LENGTH * DSHOT_BB_FRAME_SECTIONS] DMA_RAM __attribute__((aligned(16)));
+uint32_t dshot_bb_buffer_2_3[DSHOT_BB_BUFFER_LENGTH * DSHOT_BB_FRAME_SECTIONS] DMA_RAM __attribute__((aligned(16)));
 // BDSHOT response is being sampled just after transmission. There is ~33 [us] break before response (additional sampling) and bitrate is increased by 5/4:
-uint32_t dshot_bb_buffer_1_4_r[(int)(33 * BDSHOT_RESPONSE_BITRATE / 1000 + BDSHOT_RESPONSE_LENGTH + 1) * BDSHOT_RESPONSE_OVERSAMPLING];
-uint32_t dshot_bb_buffer_2_3_r[(int)(33 * BDSHOT_RESPONSE_BITRATE / 1000 + BDSHOT_RESPONSE_LENGTH + 1) * BDSHOT_RESPONSE_OVERSAMPLING];
+uint32_t dshot_bb_buffer_1_4_r[BDSHOT_RESPONSE_BUFFER_LENGTH] DMA_RAM __attribute__((aligned(16)));
+uint32_t dshot_bb_buffer_2_3_r[BDSHOT_RESPONSE_BUFFER_LENGTH] DMA_RAM __attribute__((aligned(16)));
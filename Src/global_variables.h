@@ -12,6 +12,7 @@
 #include "stdbool.h"
 
 extern uint32_t motors_rpm[];
+extern uint32_t motors_rpm_time[];
 
 extern float motors_error[];
 
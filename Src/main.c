@@ -4,6 +4,9 @@
 #include "bdshot.h"
 #include "setup.h"
 #include "global_variables.h"
+#include "benchmark.h"
+#include "dynamic_notch.h"
+#include "filter_pipeline.h"
 
 // This is only a sketch how to use RPM filters
 // You should take care of time management and updating samples
@@ -19,8 +22,12 @@ void delay_micro(uint16_t delay_time);
 int main()
 {
 
-    float gyro_measurements[3];   //  tab for measurements that you want filter
-    RPM_filter_t rpm_filter_gyro; //  RPM filter object for each sensor (with 3 axes measurements)
+    static float gyro_measurements[3] CCMRAM;   //  tab for measurements that you want filter
+    static RPM_filter_t rpm_filter_gyro CCMRAM; //  RPM filter object for each sensor (with 3 axes measurements)
+#if defined(USE_DYNAMIC_NOTCH)
+    static dynamic_notch_t dynamic_notch_gyro CCMRAM; //  notches for the rest of noises (after RPM filter)
+#endif
+    static filter_pipeline_t gyro_filters; //  all gyro filters applied in one pass
 
     // motor's values set by your PID's or by hand:
     uint16_t motor_1_value;
@@ -39,6 +46,19 @@ int main()
     setup_TIM5();                                                // setup for timining
     preset_bb_BDshot_buffers();                                  // preset buffers (do it once)
     RPM_filter_init(&rpm_filter_gyro, FREQUENCY_OF_SAMPLING_HZ); // initialize RPM filters (each filter need to be init)
+#if defined(USE_DYNAMIC_NOTCH)
+    dynamic_notch_init(&dynamic_notch_gyro, FREQUENCY_OF_SAMPLING_HZ);
+#endif
+
+    // build gyro filter chain (more stages e.g. biquad LPF or PT1 can be added the same way):
+    filter_pipeline_init(&gyro_filters);
+    filter_pipeline_add_RPM(&gyro_filters, &rpm_filter_gyro);
+#if defined(USE_DYNAMIC_NOTCH)
+    filter_pipeline_add_dynamic_notch(&gyro_filters, &dynamic_notch_gyro);
+#endif
+#if defined(USE_BENCHMARKS)
+    run_benchmarks(&rpm_filter_gyro); // results are in benchmark_results (watch them with debugger)
+#endif
 
     while (1)
     {
@@ -99,10 +119,15 @@ int main()
             // update coefficients of notches for new rpms:
             RPM_filter_update(&rpm_filter_gyro);
 
-            // next apply RPM filtering (for each measurements and axes):
-            gyro_measurements[0] = RPM_filter_apply(&rpm_filter_gyro, 0, gyro_measurements[0]);
-            gyro_measurements[1] = RPM_filter_apply(&rpm_filter_gyro, 1, gyro_measurements[1]);
-            gyro_measurements[2] = RPM_filter_apply(&rpm_filter_gyro, 2, gyro_measurements[2]);
+            // next apply RPM filtering and the rest of filters (for all axes).
+            // With USE_RPM_FILTER_DOUBLE_BUFFER only RPM_filter_apply3() can be moved to gyro interrupt (e.g. 4-8 [kHz]) - it always uses the last published notches.
+            // Dynamic notches are rewritten in place by dynamic_notch_update(), so the pipeline with USE_DYNAMIC_NOTCH has to stay in the same context:
+            filter_pipeline_apply(&gyro_filters, gyro_measurements);
+
+#if defined(USE_DYNAMIC_NOTCH)
+            // one step of remaining noise analysis:
+            dynamic_notch_update(&dynamic_notch_gyro);
+#endif
         }
         else
         {
@@ -16,17 +16,25 @@ static void setup_GPIOA();	// GPIOA (pin 2 - motor; pin 3 - motor)
 static void setup_GPIOB();	// GPIOB (pin 0 - motor; pin 1 - motor)
 static void setup_BDshot(); // Bidirectional DShot
 static void setup_DMA();
+static void setup_DWT(); // cycle counter (used by BDshot watchdog)
+#if defined(USE_BDSHOT_SCHEDULER)
+static void setup_TIM7(); // BDshot scheduler
+#endif
 
 void setup()
 {
 	// basic configuration:
 	setup_HSE();
 	setup_PLL();
+	setup_DWT();
 	// BDshot specific setup:
 	setup_GPIOA();
 	setup_GPIOB();
 	setup_BDshot();
 	setup_DMA();
+#if defined(USE_BDSHOT_SCHEDULER)
+	setup_TIM7();
+#endif
 }
 
 static void setup_HSE()
@@ -60,7 +68,7 @@ static void setup_PLL()
 	/* (3) Wait for HSI switched */
 	/* (4) Disable the PLL */
 	/* (5) Wait until PLLRDY is cleared */
-	/* (6) Configure flash */
+	/* (6) Configure flash (and ART accelerator) */
 	/* (7) Set HSE as PLL source */
 	/* (8) Set the PLLM to 4, PLLN to 168, PLLP to 2, PLLQ to 7 */
 	/* PLL_freq = PLL_clock_in / PLLM * PLLN / PLLP
@@ -96,6 +104,9 @@ static void setup_PLL()
 	}
 
 	FLASH->ACR |= FLASH_ACR_LATENCY_5WS; /* (6) */
+#if defined(USE_FLASH_ART)
+	FLASH->ACR |= FLASH_ACR_PRFTEN | FLASH_ACR_ICEN | FLASH_ACR_DCEN; /* (6) */
+#endif
 
 	RCC->PLLCFGR |= RCC_PLLCFGR_PLLSRC_HSE; /* (7) */
 
@@ -113,6 +124,15 @@ static void setup_PLL()
 	}
 }
 
+static void setup_DWT()
+{
+	// enable trace and debug blocks:
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	// reset and start cycle counter:
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
 static void setup_GPIOA()
 {
 	// enable GPIOA clock:
@@ -217,6 +237,27 @@ static void setup_BDshot()
 	TIM8->CR1 |= TIM_CR1_CEN;
 }
 
+#if defined(USE_BDSHOT_SCHEDULER)
+static void setup_TIM7()
+{
+	// enable TIM7 clock:
+	RCC->APB1ENR |= RCC_APB1ENR_TIM7EN;
+	// Timer clock is 84 [MHz]
+	// register is buffered and only overflow generate interrupt:
+	TIM7->CR1 |= TIM_CR1_ARPE | TIM_CR1_URS;
+
+	TIM7->PSC = 84 - 1;								// every 1 us 1 count
+	TIM7->ARR = 1000000 / BDSHOT_OUTPUT_RATE_HZ - 1; // BDshot frame period
+
+	//	interrupt enable:
+	TIM7->DIER |= TIM_DIER_UIE;
+
+	//	TIM7 enabling:
+	TIM7->EGR |= TIM_EGR_UG;
+	TIM7->CR1 |= TIM_CR1_CEN;
+}
+#endif
+
 static void setup_DMA()
 {
 	RCC->AHB1ENR |= RCC_AHB1ENR_DMA1EN;
@@ -229,7 +270,7 @@ static void setup_DMA()
 	{
 		; // wait
 	}
-	DMA2_Stream6->CR |= DMA_SxCR_MSIZE_1 | DMA_SxCR_PSIZE_1 | DMA_SxCR_MINC | DMA_SxCR_DIR_0 | DMA_SxCR_TCIE | DMA_SxCR_PL_0;
+	DMA2_Stream6->CR |= BDSHOT_DMA_STREAM_CONFIG;
 	// all the other parameters will be set afterward
 
 	DMA2_Stream2->CR = 0x0;
@@ -237,7 +278,7 @@ static void setup_DMA()
 	{
 		; // wait
 	}
-	DMA2_Stream2->CR |= DMA_SxCR_MSIZE_1 | DMA_SxCR_PSIZE_1 | DMA_SxCR_MINC | DMA_SxCR_DIR_0 | DMA_SxCR_TCIE | DMA_SxCR_PL_0;
+	DMA2_Stream2->CR |= BDSHOT_DMA_STREAM_CONFIG;
 	// all the other parameters will be set afterward
 }
 
@@ -248,4 +289,9 @@ void setup_NVIC()
 	NVIC_SetPriority(DMA2_Stream6_IRQn, 13);
 	NVIC_EnableIRQ(DMA2_Stream2_IRQn);
 	NVIC_SetPriority(DMA2_Stream2_IRQn, 14);
+#if defined(USE_BDSHOT_SCHEDULER)
+	// higher priority than DMA ISRs so that frames start on time:
+	NVIC_EnableIRQ(TIM7_IRQn);
+	NVIC_SetPriority(TIM7_IRQn, 12);
+#endif
 }
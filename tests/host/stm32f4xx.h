@@ -0,0 +1,13 @@
+/*
+ * stm32f4xx.h
+ *
+ *  Host stand-in for the device header (tests only). Filters need only CMSIS compiler macros and intrinsics -
+ *  core registers (DWT, NVIC) and barriers are not available, so USE_RPM_ESTIMATOR and USE_RPM_FILTER_DOUBLE_BUFFER are not built on host.
+ */
+#ifndef STM32F4XX_H_
+#define STM32F4XX_H_
+
+#include <stdint.h>
+#include "cmsis_compiler.h"
+
+#endif /* STM32F4XX_H_ */
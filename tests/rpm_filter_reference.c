@@ -0,0 +1,49 @@
+/*
+ * rpm_filter_reference.c
+ *
+ *  The same Src/filters.c built as float DF1 loop (options of the tested backend are turned off) with public functions renamed.
+ */
+
+#undef USE_RPM_FILTER_CMSIS
+#undef USE_RPM_FILTER_Q31
+#undef USE_RPM_FILTER_SVF
+#undef USE_RPM_FILTER_UNROLLED
+
+#define biquad_filter_init reference_biquad_filter_init
+#define biquad_filter_update reference_biquad_filter_update
+#define biquad_filter_apply_DF2 reference_biquad_filter_apply_DF2
+#define PT1_filter_init reference_PT1_filter_init
+#define RPM_filter_init reference_RPM_filter_init
+#define RPM_filter_apply reference_RPM_filter_apply
+#define RPM_filter_apply3 reference_RPM_filter_apply3
+#define RPM_filter_apply_block reference_RPM_filter_apply_block
+#define RPM_filter_update reference_RPM_filter_update
+#define RPM_filter_set_harmonics reference_RPM_filter_set_harmonics
+#define RPM_filter_set_q_factor reference_RPM_filter_set_q_factor
+#define RPM_filter_set_sampling_frequency reference_RPM_filter_set_sampling_frequency
+
+#include "filters.c"
+
+#include "rpm_filter_reference.h"
+
+static RPM_filter_t reference_filter;
+
+void RPM_filter_reference_init(uint16_t sampling_frequency_Hz)
+{
+	reference_RPM_filter_init(&reference_filter, sampling_frequency_Hz);
+}
+
+void RPM_filter_reference_update()
+{
+	reference_RPM_filter_update(&reference_filter);
+}
+
+void RPM_filter_reference_set_harmonics(uint8_t harmonics, uint8_t harmonics_mask)
+{
+	reference_RPM_filter_set_harmonics(&reference_filter, harmonics, harmonics_mask);
+}
+
+float RPM_filter_reference_apply(uint8_t axis, float input)
+{
+	return reference_RPM_filter_apply(&reference_filter, axis, input);
+}
@@ -0,0 +1,17 @@
+/*
+ * rpm_filter_reference.h
+ *
+ *  Float RPM filter (biquad DF1 loop over active notches) built next to the tested backend, so outputs can be compared in one test.
+ */
+
+#ifndef RPM_FILTER_REFERENCE_H_
+#define RPM_FILTER_REFERENCE_H_
+
+#include <stdint.h>
+
+void RPM_filter_reference_init(uint16_t sampling_frequency_Hz);
+void RPM_filter_reference_update();
+void RPM_filter_reference_set_harmonics(uint8_t harmonics, uint8_t harmonics_mask);
+float RPM_filter_reference_apply(uint8_t axis, float input);
+
+#endif /* RPM_FILTER_REFERENCE_H_ */
@@ -0,0 +1,409 @@
+/*
+ * test_rpm_filter.c
+ *
+ *  Host tests of RPM filter (Src/filters.c). The same file is built for each backend by tests/CMakeLists.txt.
+ *  Returns 0 if all checks passed.
+ */
+#include <stdio.h>
+#include <math.h>
+#include "global_constants.h"
+#include "filters.h"
+#include "rpm_filter_reference.h"
+
+#define TEST_SAMPLES_PER_UPDATE 9 // RPM_filter_update() is called every 10 [ms] (telemetry rate) at FREQUENCY_OF_SAMPLING_HZ = 900
+#define TEST_AMPLITUDE 100.f      // gyro [deg/s] (within RPM_FILTER_Q31_RANGE)
+
+#define TEST_AGREEMENT_TOLERANCE 1e-3f      // max. difference between apply functions (the same notches) [deg/s]
+#define TEST_NOTCH_ATTENUATION_DB -50.f     // steady tone at motor frequency
+#define TEST_PASSBAND_ATTENUATION_DB -1.f   // tone between notches is not affected
+#define TEST_CHIRP_ATTENUATION_DB -20.f     // tone follows accelerating motor - notches are retuned every update
+#define TEST_CHIRP_WINDOW_UPDATES 10        // residual of the chirp is also measured in 100 [ms] windows (retuning transients, ringing)
+#define TEST_CHIRP_WINDOW_ATTENUATION_DB -15.f // the worst window
+#if defined(USE_RPM_FILTER_SVF)
+#define TEST_CHIRP_REFERENCE_DB -1.f        // the worst window compared with float DF1 loop (SVF has smaller retuning transients)
+#else
+#define TEST_CHIRP_REFERENCE_DB 0.5f        // the worst window compared with float DF1 loop
+#endif
+#define TEST_REFERENCE_TOLERANCE 0.1f       // max. difference from float DF1 reference after notches settled (-60 dB of TEST_AMPLITUDE) [deg/s]
+#define TEST_REFERENCE_SWEEP_DB 0.5f        // max. difference of output energy from float DF1 reference during fade (folded weights) [dB]
+
+// normally decoded from BDshot telemetry (global_variables.c):
+uint32_t motors_rpm[MOTORS_COUNT];
+uint32_t motors_rpm_time[MOTORS_COUNT];
+
+static const uint32_t motors_rpm_default[MOTORS_COUNT] = {6000, 8000, 10000, 11000}; // 100, 133, 167, 183 [Hz] fundamentals
+
+static int failures = 0;
+
+static void check(bool condition, const char *name, float value, float limit)
+{
+	printf("%-40s %10.4f (limit %10.4f) %s\n", name, value, limit, condition ? "ok" : "FAILED");
+	if (!condition)
+	{
+		failures++;
+	}
+}
+
+static void set_motors_rpm(uint32_t motor_1_rpm)
+{
+	for (uint8_t motor = 0; motor < MOTORS_COUNT; motor++)
+	{
+		motors_rpm[motor] = motors_rpm_default[motor];
+	}
+	motors_rpm[0] = motor_1_rpm;
+}
+
+static float tone_at(double *phase, double frequency_Hz, uint16_t sampling_frequency_Hz)
+{
+	// phase is kept in [0, 1) so sin() is precise for long runs:
+	*phase = fmod(*phase + frequency_Hz / sampling_frequency_Hz, 1.);
+	return TEST_AMPLITUDE * (float)sin(2 * M_PI * *phase);
+}
+
+static float tone(double *phase, double frequency_Hz)
+{
+	return tone_at(phase, frequency_Hz, FREQUENCY_OF_SAMPLING_HZ);
+}
+
+static void test_apply_agreement()
+{
+	// RPM_filter_apply(), RPM_filter_apply3() and RPM_filter_apply_block() have to give the same output for the same notches:
+	static RPM_filter_t filter_apply, filter_apply3, filter_block;
+	double phase[3] = {0, 0.25, 0.5};
+	double phase_passband[3] = {0, 0, 0};
+	float max_difference_apply3 = 0;
+	float max_difference_block = 0;
+
+	set_motors_rpm(motors_rpm_default[0]);
+	RPM_filter_init(&filter_apply, FREQUENCY_OF_SAMPLING_HZ);
+	RPM_filter_init(&filter_apply3, FREQUENCY_OF_SAMPLING_HZ);
+	RPM_filter_init(&filter_block, FREQUENCY_OF_SAMPLING_HZ);
+
+	for (uint16_t update = 0; update < 500; update++)
+	{
+		// motor 1 accelerates so notches are retuned and faded in from below min. frequency:
+		set_motors_rpm(2000 + 20 * update);
+		RPM_filter_update(&filter_apply);
+		RPM_filter_update(&filter_apply3);
+		RPM_filter_update(&filter_block);
+
+		float output_apply[3][TEST_SAMPLES_PER_UPDATE];
+		float output_apply3[3][TEST_SAMPLES_PER_UPDATE];
+		float output_block[3][TEST_SAMPLES_PER_UPDATE];
+		const float frequency = motors_rpm[0] / 60.f;
+
+		for (uint8_t n = 0; n < TEST_SAMPLES_PER_UPDATE; n++)
+		{
+			float xyz[3];
+			for (uint8_t axis = 0; axis < 3; axis++)
+			{
+				// the same notched tone with a different phase and some signal between notches:
+				xyz[axis] = tone(&phase[axis], frequency) + 0.3f * tone(&phase_passband[axis], 117. + 10 * axis);
+				output_apply[axis][n] = RPM_filter_apply(&filter_apply, axis, xyz[axis]);
+				output_block[axis][n] = xyz[axis];
+			}
+			RPM_filter_apply3(&filter_apply3, xyz);
+			for (uint8_t axis = 0; axis < 3; axis++)
+			{
+				output_apply3[axis][n] = xyz[axis];
+			}
+		}
+		for (uint8_t axis = 0; axis < 3; axis++)
+		{
+			RPM_filter_apply_block(&filter_block, axis, output_block[axis], TEST_SAMPLES_PER_UPDATE);
+		}
+
+		for (uint8_t axis = 0; axis < 3; axis++)
+		{
+			for (uint8_t n = 0; n < TEST_SAMPLES_PER_UPDATE; n++)
+			{
+				max_difference_apply3 = fmaxf(max_difference_apply3, fabsf(output_apply3[axis][n] - output_apply[axis][n]));
+				max_difference_block = fmaxf(max_difference_block, fabsf(output_block[axis][n] - output_apply[axis][n]));
+			}
+		}
+	}
+
+	check(max_difference_apply3 <= TEST_AGREEMENT_TOLERANCE, "apply3 vs apply max. difference", max_difference_apply3, TEST_AGREEMENT_TOLERANCE);
+	check(max_difference_block <= TEST_AGREEMENT_TOLERANCE, "apply_block vs apply max. difference", max_difference_block, TEST_AGREEMENT_TOLERANCE);
+}
+
+#if defined(USE_RPM_FILTER_Q31)
+static void test_q31_agreement()
+{
+	// RPM_filter_apply_q31() and RPM_filter_apply_block_q31() (gyro already in Q31) have to give the same output as RPM_filter_apply():
+	static RPM_filter_t filter_apply, filter_q31, filter_block_q31;
+	double phase = 0;
+	double phase_passband = 0;
+	float max_difference_q31 = 0;
+	float max_difference_block_q31 = 0;
+
+	set_motors_rpm(motors_rpm_default[0]);
+	RPM_filter_init(&filter_apply, FREQUENCY_OF_SAMPLING_HZ);
+	RPM_filter_init(&filter_q31, FREQUENCY_OF_SAMPLING_HZ);
+	RPM_filter_init(&filter_block_q31, FREQUENCY_OF_SAMPLING_HZ);
+
+	for (uint16_t update = 0; update < 500; update++)
+	{
+		set_motors_rpm(2000 + 20 * update);
+		RPM_filter_update(&filter_apply);
+		RPM_filter_update(&filter_q31);
+		RPM_filter_update(&filter_block_q31);
+
+		float output_apply[TEST_SAMPLES_PER_UPDATE];
+		q31_t output_q31[TEST_SAMPLES_PER_UPDATE];
+		q31_t output_block_q31[TEST_SAMPLES_PER_UPDATE];
+		const float frequency = motors_rpm[0] / 60.f;
+
+		for (uint8_t n = 0; n < TEST_SAMPLES_PER_UPDATE; n++)
+		{
+			const float input = tone(&phase, frequency) + 0.3f * tone(&phase_passband, 117.);
+			const q31_t input_q31 = (q31_t)(input * (2147483648.f / RPM_FILTER_Q31_RANGE));
+			output_apply[n] = RPM_filter_apply(&filter_apply, 0, input);
+			output_q31[n] = RPM_filter_apply_q31(&filter_q31, 0, input_q31);
+			output_block_q31[n] = input_q31;
+		}
+		RPM_filter_apply_block_q31(&filter_block_q31, 0, output_block_q31, TEST_SAMPLES_PER_UPDATE);
+
+		for (uint8_t n = 0; n < TEST_SAMPLES_PER_UPDATE; n++)
+		{
+			const float output_q31_float = output_q31[n] * (RPM_FILTER_Q31_RANGE / 2147483648.f);
+			const float output_block_q31_float = output_block_q31[n] * (RPM_FILTER_Q31_RANGE / 2147483648.f);
+			max_difference_q31 = fmaxf(max_difference_q31, fabsf(output_q31_float - output_apply[n]));
+			max_difference_block_q31 = fmaxf(max_difference_block_q31, fabsf(output_block_q31_float - output_apply[n]));
+		}
+	}
+
+	check(max_difference_q31 <= TEST_AGREEMENT_TOLERANCE, "apply_q31 vs apply max. difference", max_difference_q31, TEST_AGREEMENT_TOLERANCE);
+	check(max_difference_block_q31 <= TEST_AGREEMENT_TOLERANCE, "apply_block_q31 vs apply max. difference", max_difference_block_q31, TEST_AGREEMENT_TOLERANCE);
+}
+#endif
+
+static float attenuation_dB(uint32_t motor_1_rpm, double tone_frequency_Hz)
+{
+	// steady motors - output to input power of a tone after notches settled (Q = 500 needs a few seconds):
+	static RPM_filter_t filter;
+	double phase = 0;
+	double input_power = 0;
+	double output_power = 0;
+
+	set_motors_rpm(motor_1_rpm);
+	RPM_filter_init(&filter, FREQUENCY_OF_SAMPLING_HZ);
+
+	for (uint16_t update = 0; update < 1500; update++)
+	{
+		RPM_filter_update(&filter);
+		for (uint8_t n = 0; n < TEST_SAMPLES_PER_UPDATE; n++)
+		{
+			const float input = tone(&phase, tone_frequency_Hz);
+			const float output = RPM_filter_apply(&filter, 0, input);
+			if (update >= 1200)
+			{
+				input_power += input * input;
+				output_power += output * output;
+			}
+		}
+	}
+
+	return 10 * log10f((float)(output_power / input_power));
+}
+
+static void test_attenuation()
+{
+	// the tone is 1 [rpm] away from the initial notch frequency (it has to be retuned):
+	const float notch = attenuation_dB(6001, 6001 / 60.);
+	check(notch <= TEST_NOTCH_ATTENUATION_DB, "notched tone attenuation [dB]", notch, TEST_NOTCH_ATTENUATION_DB);
+
+	const float passband = attenuation_dB(6001, 117.);
+	check(passband >= TEST_PASSBAND_ATTENUATION_DB, "tone between notches attenuation [dB]", passband, TEST_PASSBAND_ATTENUATION_DB);
+}
+
+static float power_ratio_dB(double output_power, double input_power)
+{
+	return 10 * log10f((float)(output_power / input_power));
+}
+
+static void test_chirp()
+{
+	// motor 1 accelerates from 6000 to 9000 [rpm] in 3 [s] and stays at 9000 [rpm] for 1 [s] - notches are retuned every update and the tone follows them.
+	// Residual of the whole sweep hides short bursts, so it is also measured in windows (retuning transients, ringing after the sweep).
+	// The same is done with float DF1 loop (rpm_filter_reference.c) - backends are compared with it directly:
+	static RPM_filter_t filter;
+	double phase = 0;
+	double input_power = 0;
+	double output_power = 0;
+	double window_input_power = 0;
+	double window_output_power = 0;
+	double window_reference_power = 0;
+	float worst_window = -INFINITY;
+	float worst_window_reference = -INFINITY;
+
+	set_motors_rpm(6000);
+	RPM_filter_init(&filter, FREQUENCY_OF_SAMPLING_HZ);
+	RPM_filter_reference_init(FREQUENCY_OF_SAMPLING_HZ);
+
+	for (uint16_t update = 0; update < 900; update++)
+	{
+		const uint32_t rpm = update < 500 ? 6000 : update < 800 ? 6000 + 10 * (update - 500) : 9000;
+		set_motors_rpm(rpm);
+		RPM_filter_update(&filter);
+		RPM_filter_reference_update();
+		for (uint8_t n = 0; n < TEST_SAMPLES_PER_UPDATE; n++)
+		{
+			const float input = tone(&phase, rpm / 60.);
+			const float output = RPM_filter_apply(&filter, 0, input);
+			const float reference = RPM_filter_reference_apply(0, input);
+			if (update >= 500 && update < 800)
+			{
+				input_power += input * input;
+				output_power += output * output;
+			}
+			window_input_power += input * input;
+			window_output_power += output * output;
+			window_reference_power += reference * reference;
+		}
+
+		if ((update + 1) % TEST_CHIRP_WINDOW_UPDATES == 0)
+		{
+			if (update >= 500)
+			{
+				worst_window = fmaxf(worst_window, power_ratio_dB(window_output_power, window_input_power));
+				worst_window_reference = fmaxf(worst_window_reference, power_ratio_dB(window_reference_power, window_input_power));
+			}
+			window_input_power = 0;
+			window_output_power = 0;
+			window_reference_power = 0;
+		}
+	}
+
+	const float chirp = power_ratio_dB(output_power, input_power);
+	check(chirp <= TEST_CHIRP_ATTENUATION_DB, "chirp attenuation [dB]", chirp, TEST_CHIRP_ATTENUATION_DB);
+	check(worst_window <= TEST_CHIRP_WINDOW_ATTENUATION_DB, "chirp worst window attenuation [dB]", worst_window, TEST_CHIRP_WINDOW_ATTENUATION_DB);
+	const float versus_reference = worst_window - worst_window_reference;
+	check(versus_reference <= TEST_CHIRP_REFERENCE_DB, "chirp worst window vs float DF1 [dB]", versus_reference, TEST_CHIRP_REFERENCE_DB);
+}
+
+#if !defined(USE_RPM_FILTER_SVF)
+static float reference_step_difference(uint16_t sampling_frequency_Hz)
+{
+	// motor 1 steps from below min. frequency through the fade range to full notch (weights and folded coefficients change)
+	// and harmonics are switched off and on. Each step is held until notches settle (Q = 500 - time constant ~3 [s] at 50 [Hz]),
+	// then output is compared with float DF1 loop (rpm_filter_reference.c) - folding is exact for constant weight:
+	static RPM_filter_t filter;
+	static const uint32_t steps_rpm[] = {2400, 3300, 4500, 5700, 7000, 7000, 4500};
+	const uint16_t samples_per_update = sampling_frequency_Hz / 100;
+	const uint16_t updates_per_step = 3000;
+	double phase = 0;
+	double phase_passband = 0;
+	float max_difference = 0;
+
+	set_motors_rpm(steps_rpm[0]);
+	RPM_filter_init(&filter, sampling_frequency_Hz);
+	RPM_filter_reference_init(sampling_frequency_Hz);
+
+	for (uint8_t step = 0; step < sizeof(steps_rpm) / sizeof(steps_rpm[0]); step++)
+	{
+		const uint32_t rpm = steps_rpm[step];
+		set_motors_rpm(rpm);
+		if (step == 5)
+		{
+			RPM_filter_set_harmonics(&filter, 2, 0x01);
+			RPM_filter_reference_set_harmonics(2, 0x01);
+		}
+		if (step == 6)
+		{
+			RPM_filter_set_harmonics(&filter, RPM_MAX_HARMONICS, RPM_HARMONICS_MASK);
+			RPM_filter_reference_set_harmonics(RPM_MAX_HARMONICS, RPM_HARMONICS_MASK);
+		}
+
+		for (uint16_t update = 0; update < updates_per_step; update++)
+		{
+			RPM_filter_update(&filter);
+			RPM_filter_reference_update();
+			for (uint16_t n = 0; n < samples_per_update; n++)
+			{
+				const float input = tone_at(&phase, rpm / 60., sampling_frequency_Hz) + 0.3f * tone_at(&phase_passband, 117., sampling_frequency_Hz);
+				const float output = RPM_filter_apply(&filter, 0, input);
+				const float reference = RPM_filter_reference_apply(0, input);
+				if (update >= updates_per_step - 100)
+				{
+					max_difference = fmaxf(max_difference, fabsf(output - reference));
+				}
+			}
+		}
+	}
+
+	return max_difference;
+}
+
+static float reference_sweep_difference_dB(uint16_t sampling_frequency_Hz)
+{
+	// motor 1 accelerates through the fade range with the tone at its frequency - weights change every update, so folded notch
+	// has different transients than blended one. Energy of what passes through has to be close to the reference:
+	static RPM_filter_t filter;
+	const uint16_t samples_per_update = sampling_frequency_Hz / 100;
+	double phase = 0;
+	double output_energy = 0;
+	double reference_energy = 0;
+
+	set_motors_rpm(2000);
+	RPM_filter_init(&filter, sampling_frequency_Hz);
+	RPM_filter_reference_init(sampling_frequency_Hz);
+
+	// notches settle at 2000 [rpm] first (start-up transients are not a part of the fade):
+	for (uint16_t update = 0; update < 4000; update++)
+	{
+		// 2000 -> 7000 -> 2000 [rpm] (33 -> 117 -> 33 [Hz]):
+		const uint32_t rpm = update < 3000 ? 2000 : update < 3500 ? 2000 + 10 * (update - 3000) : 7000 - 10 * (update - 3500);
+		set_motors_rpm(rpm);
+		RPM_filter_update(&filter);
+		RPM_filter_reference_update();
+
+		for (uint16_t n = 0; n < samples_per_update; n++)
+		{
+			const float input = tone_at(&phase, rpm / 60., sampling_frequency_Hz);
+			const float output = RPM_filter_apply(&filter, 0, input);
+			const float reference = RPM_filter_reference_apply(0, input);
+			if (update >= 3000)
+			{
+				output_energy += output * output;
+				reference_energy += reference * reference;
+			}
+		}
+	}
+
+	return fabsf(10 * log10f((float)(output_energy / reference_energy)));
+}
+
+static void test_reference_agreement()
+{
+	// gyro loop rate and high rate (Q = 500 notches at low f / fs are the hardest for coefficients precision):
+	const uint16_t rates[] = {FREQUENCY_OF_SAMPLING_HZ, 8000};
+	for (uint8_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+	{
+		char name[64];
+		const float difference = reference_step_difference(rates[i]);
+		snprintf(name, sizeof(name), "reference max. difference (%u Hz)", rates[i]);
+		check(difference <= TEST_REFERENCE_TOLERANCE, name, difference, TEST_REFERENCE_TOLERANCE);
+
+		const float sweep = reference_sweep_difference_dB(rates[i]);
+		snprintf(name, sizeof(name), "reference sweep energy difference [dB] (%u Hz)", rates[i]);
+		check(sweep <= TEST_REFERENCE_SWEEP_DB, name, sweep, TEST_REFERENCE_SWEEP_DB);
+	}
+}
+#endif
+
+int main()
+{
+	test_apply_agreement();
+#if defined(USE_RPM_FILTER_Q31)
+	test_q31_agreement();
+#endif
+#if !defined(USE_RPM_FILTER_SVF)
+	test_reference_agreement();
+#endif
+	test_attenuation();
+	test_chirp();
+
+	printf("%s\n", failures == 0 ? "all checks passed" : "some checks FAILED");
+	return failures == 0 ? 0 : 1;
+}